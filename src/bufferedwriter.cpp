@@ -0,0 +1,120 @@
+/*
+
+    Buffered output writer
+    shygoo 2020
+    License: MIT
+
+*/
+
+#include <cstdarg>
+#include <cstring>
+#include <vector>
+
+#include "bufferedwriter.h"
+
+CBufferedWriter::CBufferedWriter(FILE *file) :
+    m_File(file),
+    m_Buffer(NULL),
+    m_Length(0),
+    m_bErrored(false)
+{
+    m_Buffer = new char[BUFFEREDWRITER_CAPACITY];
+}
+
+CBufferedWriter::~CBufferedWriter()
+{
+    Flush();
+    delete[] m_Buffer;
+}
+
+bool CBufferedWriter::Flush()
+{
+    if(m_Length != 0 && fwrite(m_Buffer, 1, m_Length, m_File) != m_Length)
+    {
+        m_bErrored = true;
+    }
+
+    m_Length = 0;
+    return !m_bErrored;
+}
+
+bool CBufferedWriter::Errored()
+{
+    return m_bErrored;
+}
+
+void CBufferedWriter::Write(const char *data, size_t length)
+{
+    if(length > BUFFEREDWRITER_CAPACITY - m_Length)
+    {
+        Flush();
+
+        if(length > BUFFEREDWRITER_CAPACITY)
+        {
+            if(fwrite(data, 1, length, m_File) != length)
+            {
+                m_bErrored = true;
+            }
+            return;
+        }
+    }
+
+    memcpy(&m_Buffer[m_Length], data, length);
+    m_Length += length;
+}
+
+void CBufferedWriter::WriteString(const char *str)
+{
+    Write(str, strlen(str));
+}
+
+// uppercase, zero-padded to nDigits (at most 8)
+void CBufferedWriter::WriteHex(uint32_t value, int nDigits)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    char str[8];
+
+    for(int i = nDigits - 1; i >= 0; i--)
+    {
+        str[i] = digits[value & 0xF];
+        value >>= 4;
+    }
+
+    Write(str, nDigits);
+}
+
+void CBufferedWriter::Printf(const char *format, ...)
+{
+    va_list args, args2;
+    va_start(args, format);
+    va_copy(args2, args);
+
+    // format straight into the buffer, flushing first if it did not fit
+    size_t available = BUFFEREDWRITER_CAPACITY - m_Length;
+    int length = vsnprintf(&m_Buffer[m_Length], available, format, args);
+
+    if(length >= 0 && (size_t)length >= available)
+    {
+        Flush();
+
+        if((size_t)length < BUFFEREDWRITER_CAPACITY)
+        {
+            vsnprintf(m_Buffer, BUFFEREDWRITER_CAPACITY, format, args2);
+        }
+        else
+        {
+            std::vector<char> str(length + 1);
+            vsnprintf(str.data(), str.size(), format, args2);
+            Write(str.data(), length);
+            length = 0;
+        }
+    }
+
+    if(length > 0)
+    {
+        m_Length += length;
+    }
+
+    va_end(args2);
+    va_end(args);
+}
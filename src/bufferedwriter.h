@@ -0,0 +1,38 @@
+/*
+
+    Buffered output writer
+    shygoo 2020
+    License: MIT
+
+*/
+
+#ifndef BUFFEREDWRITER_H
+#define BUFFEREDWRITER_H
+
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+
+#define BUFFEREDWRITER_CAPACITY 0x100000
+
+// collects output in memory and hands it to the file in large chunks
+class CBufferedWriter
+{
+    FILE  *m_File;
+    char  *m_Buffer;
+    size_t m_Length;
+    bool   m_bErrored;
+
+public:
+    CBufferedWriter(FILE *file);
+    ~CBufferedWriter();
+
+    void Write(const char *data, size_t length);
+    void WriteString(const char *str);
+    void WriteHex(uint32_t value, int nDigits);
+    void Printf(const char *format, ...);
+    bool Flush();
+    bool Errored();
+};
+
+#endif // BUFFEREDWRITER_H
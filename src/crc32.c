@@ -56,6 +56,22 @@ void crc32_read(const uint8_t *bytes, size_t length, uint32_t *result)
     }
 }
 
+// updates two crcs with the same bytes in one pass
+void crc32_read2(const uint8_t *bytes, size_t length, uint32_t *resultA, uint32_t *resultB)
+{
+    uint32_t a = *resultA;
+    uint32_t b = *resultB;
+
+    for(size_t i = 0; i < length; i++)
+    {
+        a = (crc32_table[(a & 0xFF) ^ bytes[i]] ^ (a >> 8));
+        b = (crc32_table[(b & 0xFF) ^ bytes[i]] ^ (b >> 8));
+    }
+
+    *resultA = a;
+    *resultB = b;
+}
+
 void crc32_end(uint32_t *result)
 {
     *result = ~*result;
@@ -1,9 +1,31 @@
+/*
+
+    elf2pj64
+    Symbol map builder and n64sym evaluation tool
+    shygoo 2020
+    License: MIT
+
+*/
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <chrono>
+#include <map>
 #include <set>
+#include <string>
+#include <vector>
 
 #include "elfutil.h"
+#include "n64sym.h"
+
+typedef struct
+{
+    uint32_t address;
+    uint32_t size;
+    const char *type_name;
+    const char *name;
+} elf_symbol_t;
 
 const char *get_uint_type_name(uint32_t symbol_size)
 {
@@ -18,25 +40,29 @@ const char *get_uint_type_name(uint32_t symbol_size)
     return "data";
 }
 
-void elf_report_symbols(CElfContext *elf)
+void elf_collect_symbols(CElfContext *elf, std::vector<elf_symbol_t>& symbols)
 {
-    std::set<uint32_t> reported_addresses;
-
     int num_symbols = elf->NumSymbols();
 
     for(int i = 0; i < num_symbols; i++)
     {
         CElfSymbol *symbol = elf->Symbol(i);
-        CElfSection *section = symbol->Section(elf);
 
-        const char *symbol_name = symbol->Name(elf);
-        uint32_t symbol_value = symbol->Value();
-        uint32_t symbol_size = symbol->Size();
+        if(symbol->SectionIndex() == SHN_UNDEF ||
+           symbol->SectionIndex() >= SHN_LORESERVE ||
+           symbol->Type() == STT_SECTION ||
+           symbol->Type() == STT_FILE)
+        {
+            continue;
+        }
 
-        const char* type_name;
+        elf_symbol_t elf_symbol;
+        elf_symbol.address = symbol->Value();
+        elf_symbol.size = symbol->Size();
+        elf_symbol.name = symbol->Name(elf);
+        elf_symbol.type_name = "data";
 
-        if(symbol->SectionIndex() >= SHN_LORESERVE ||
-           symbol->Type() == STT_SECTION)
+        if(elf_symbol.name[0] == '\0')
         {
             continue;
         }
@@ -44,77 +70,238 @@ void elf_report_symbols(CElfContext *elf)
         if(symbol->Size() == 0)
         {
             // assume it's code
-            type_name = "code";
+            elf_symbol.type_name = "code";
         }
         else
         {
             switch(symbol->Type())
             {
-            case STT_NOTYPE:
-                type_name = "data";
-                break;
             case STT_OBJECT:
-                type_name = get_uint_type_name(symbol_size);
+                elf_symbol.type_name = get_uint_type_name(elf_symbol.size);
                 break;
             case STT_FUNC:
-                type_name = "code";
+                elf_symbol.type_name = "code";
                 break;
-            
             }
         }
 
-        //printf("%s\n", section_name);
-        if(reported_addresses.count(symbol_value) == 0)
+        symbols.push_back(elf_symbol);
+    }
+}
+
+void elf_report_symbols(std::vector<elf_symbol_t>& symbols)
+{
+    // same layout as n64sym -f pj64
+    std::set<uint32_t> reported_addresses;
+
+    for(auto& symbol : symbols)
+    {
+        if(reported_addresses.count(symbol.address) == 0)
         {
-            printf("%s,0x%08X,%s\n", type_name, symbol_value, symbol_name);
-            reported_addresses.insert(symbol_value);
+            printf("%08X,%s,%s\n", symbol.address, symbol.type_name, symbol.name);
+            reported_addresses.insert(symbol.address);
         }
     }
+}
+
+bool evaluate(std::vector<elf_symbol_t>& symbols, CN64Sym& n64sym)
+{
+    // sized symbols that fall inside the binary are the ground truth
+    std::map<uint32_t, std::set<std::string>> truth;
 
-    for(std::set<uint32_t>::iterator iter = reported_addresses.begin(); iter != reported_addresses.end(); iter++)
+    auto t0 = std::chrono::steady_clock::now();
+
+    if(!n64sym.Run())
+    {
+        return false;
+    }
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    uint32_t start_address = n64sym.GetHeaderSize();
+    uint32_t end_address = start_address + n64sym.GetBinarySize();
+
+    for(auto& symbol : symbols)
+    {
+        if(symbol.size != 0 && symbol.address >= start_address && symbol.address < end_address)
+        {
+            truth[symbol.address].insert(symbol.name);
+        }
+    }
+
+    size_t num_results = n64sym.GetNumResults();
+    size_t num_correct = 0;
+    size_t num_wrong_name = 0;
+    size_t num_unknown_address = 0;
+    std::set<uint32_t> found_addresses;
+
+    for(size_t i = 0; i < num_results; i++)
     {
-        printf("%08X\n", *iter);
+        uint32_t address = n64sym.GetResultAddress(i);
+        auto names = truth.find(address);
+
+        if(names == truth.end())
+        {
+            num_unknown_address++;
+        }
+        else if(names->second.count(n64sym.GetResultName(i)) == 0)
+        {
+            num_wrong_name++;
+        }
+        else
+        {
+            num_correct++;
+            found_addresses.insert(address);
+        }
     }
 
-    printf("finished\n");
+    double precision = num_results ? (100.0 * num_correct / num_results) : 0.0;
+    double recall = truth.size() ? (100.0 * found_addresses.size() / truth.size()) : 0.0;
+    double seconds = std::chrono::duration<double>(t1 - t0).count();
+
+    printf("truth symbols:   %zu\n", truth.size());
+    printf("results:         %zu\n", num_results);
+    printf("  correct:       %zu\n", num_correct);
+    printf("  wrong name:    %zu\n", num_wrong_name);
+    printf("  not in elf:    %zu\n", num_unknown_address);
+    printf("precision:       %.2f%%\n", precision);
+    printf("recall:          %.2f%% (%zu/%zu)\n", recall, found_addresses.size(), truth.size());
+    printf("wall time:       %.3f s\n", seconds);
+    printf("candidate tests: %zu\n", n64sym.GetNumCandidateTests());
+
+    return true;
 }
 
 int main(int argc, const char* argv[])
 {
     const char *elf_path;
-    FILE *elf_fp;
-    char *elf_buffer;
-    size_t elf_size;
-
-    CElfContext *elf;
+    CElfContext elf;
 
     if(argc < 2)
     {
-        printf("elf2pj64 <elf_file>\n");
+        printf(
+            "elf2pj64 - symbol map builder and n64sym evaluation tool (https://github.com/shygoo/n64sym)\n\n"
+            "  Usage: elf2pj64 <elf path>\n"
+            "         elf2pj64 <elf path> -e <binary path> [options]\n\n"
+            "  Options:\n"
+            "    -e <binary path>           run n64sym on the binary and compare its results with the elf's symbols\n"
+            "    -s                         scan for symbols from built-in signature file\n"
+            "    -l <sig/lib/obj path>      scan for symbols from signature/library/object file(s)\n"
+            "    -h <headersize>            set the headersize (default: 0x80000000)\n"
+            "    -t                         scan thoroughly\n"
+            "    -o <output path>           write n64sym's results to a file\n"
+        );
         return EXIT_FAILURE;
     }
 
     elf_path = argv[1];
-    elf_fp = fopen(elf_path, "rb");
 
-    if(elf_fp == NULL)
+    if(!elf.Load(elf_path))
     {
-        printf("failed to open %s'", elf_path);
+        printf("Error: Failed to load '%s'\n", elf_path);
         return EXIT_FAILURE;
     }
 
-    fseek(elf_fp, 0, SEEK_END);
-    elf_size = ftell(elf_fp);
-    rewind(elf_fp);
+    std::vector<elf_symbol_t> symbols;
+    elf_collect_symbols(&elf, symbols);
+
+    if(argc == 2)
+    {
+        elf_report_symbols(symbols);
+        return EXIT_SUCCESS;
+    }
+
+    CN64Sym n64sym;
+    const char *bin_path = NULL;
+    bool b_have_header_size = false;
+    uint32_t header_size = 0;
+
+    n64sym.SetDumpResults(false);
+
+    for(int argi = 2; argi < argc; argi++)
+    {
+        if(argv[argi][0] != '-' || strlen(&argv[argi][1]) != 1)
+        {
+            printf("Error: Unexpected '%s' in command line\n", argv[argi]);
+            return EXIT_FAILURE;
+        }
+
+        bool b_have_param = (argi + 1 < argc);
+
+        switch(argv[argi][1])
+        {
+        case 'e':
+            if(!b_have_param)
+            {
+                printf("Error: No path specified for '-e'\n");
+                return EXIT_FAILURE;
+            }
+            bin_path = argv[++argi];
+            break;
+        case 'l':
+            if(!b_have_param)
+            {
+                printf("Error: No path specified for '-l'\n");
+                return EXIT_FAILURE;
+            }
+            n64sym.AddLibPath(argv[++argi]);
+            break;
+        case 's':
+            n64sym.UseBuiltinSignatures(true);
+            break;
+        case 't':
+            n64sym.SetThoroughScan(true);
+            break;
+        case 'h':
+            if(!b_have_param)
+            {
+                printf("Error: No header size specified for '-h'\n");
+                return EXIT_FAILURE;
+            }
+            b_have_header_size = true;
+            header_size = strtoul(argv[++argi], NULL, 0);
+            break;
+        case 'o':
+            if(!b_have_param)
+            {
+                printf("Error: No path specified for '-o'\n");
+                return EXIT_FAILURE;
+            }
+            if(!n64sym.AddOutputPath(argv[++argi]))
+            {
+                printf("Error: Could not open '%s'\n", argv[argi]);
+                return EXIT_FAILURE;
+            }
+            n64sym.SetDumpResults(true);
+            break;
+        default:
+            printf("Error: Invalid switch '%s'\n", argv[argi]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(bin_path == NULL)
+    {
+        printf("Error: No binary specified, use '-e'\n");
+        return EXIT_FAILURE;
+    }
 
-    elf_buffer = (char*) malloc(elf_size);
-    int nbytesread = fread(elf_buffer, 1, elf_size, elf_fp);
-    fclose(elf_fp);
+    // the header size changes how LoadBinary treats ROM images
+    if(b_have_header_size)
+    {
+        n64sym.SetHeaderSize(header_size);
+    }
 
-    elf = new CElfContext(elf_buffer, elf_size);
+    if(!n64sym.LoadBinary(bin_path))
+    {
+        printf("Error: Failed to load '%s'\n", bin_path);
+        return EXIT_FAILURE;
+    }
 
-    elf_report_symbols(elf);
+    if(!evaluate(symbols, n64sym))
+    {
+        return EXIT_FAILURE;
+    }
 
-    free(elf_buffer);
-    delete elf;
-}
\ No newline at end of file
+    return EXIT_SUCCESS;
+}
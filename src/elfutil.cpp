@@ -22,6 +22,11 @@ CElfContext::CElfContext():
 {
 }
 
+CElfContext::~CElfContext()
+{
+    delete[] m_Buffer;
+}
+
 bool CElfContext::Load(const char *path)
 {
     std::ifstream file;
@@ -56,6 +56,21 @@
 #define ELFCLASS32   1 // 32-bit objects
 #define ELFCLASS64   2 // 64-bit objects
 
+// object file types
+#define ET_NONE 0
+#define ET_REL  1
+#define ET_EXEC 2
+
+// section types
+#define SHT_NULL     0
+#define SHT_PROGBITS 1
+#define SHT_NOBITS   8
+
+// section flags
+#define SHF_WRITE     0x1
+#define SHF_ALLOC     0x2
+#define SHF_EXECINSTR 0x4
+
 // mips relocation types
 #define R_MIPS_NONE     0
 #define R_MIPS_16       1
@@ -128,11 +143,13 @@ public:
     CElfHeader* Header() { return (CElfHeader *)m_Buffer; }
 
     CElfContext();
+    ~CElfContext();
     
     bool Load(const char *path);
     bool LoadFromMemory(uint8_t *buffer, size_t size);
 
     uint8_t  ABI() { return Header()->e_ident[EI_OSABI]; }
+    uint16_t Type() { return bswap16(Header()->e_type); }
     uint16_t Machine() { return bswap16(Header()->e_machine); }
     uint32_t SectionHeaderOffset() { return bswap32(Header()->e_shoff); }
     uint16_t SectionHeaderEntrySize() { return bswap16(Header()->e_shentsize); }
@@ -167,6 +184,9 @@ class CElfSection
 
 public:
     uint32_t NameOffset() { return bswap32(sh_name); }
+    uint32_t Type() { return bswap32(sh_type); }
+    uint32_t Flags() { return bswap32(sh_flags); }
+    uint32_t Address() { return bswap32(sh_addr); }
     uint32_t Offset() { return bswap32(sh_offset); }
     uint32_t Size() { return bswap32(sh_size); }
 
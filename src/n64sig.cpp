@@ -17,18 +17,23 @@
 #include <cstring>
 
 #include "n64sig.h"
+#include "signaturefile.h"
 #include "arutil.h"
 #include "pathutil.h"
 #include "crc32.h"
+#include "bufferedwriter.h"
 
 #ifndef min
 #define min(a, b) (((a) < (b)) ? (a) : (b))
 #endif
 
 CN64Sig::CN64Sig() :
+    m_CachePath(NULL),
     m_bVerbose(false),
     m_OutputFormat(N64SIG_FMT_DEFAULT),
-    m_NumProcessedSymbols(0)
+    m_BlockSize(0),
+    m_NumProcessedSymbols(0),
+    m_NumCachedObjects(0)
 {
 }
 
@@ -41,6 +46,26 @@ void CN64Sig::AddLibPath(const char *path)
     m_LibPaths.push_back(path);
 }
 
+void CN64Sig::AddSigPath(const char *path)
+{
+    m_SigPaths.push_back(path);
+}
+
+void CN64Sig::AddElfPath(const char *path)
+{
+    m_ElfPaths.push_back(path);
+}
+
+void CN64Sig::AddOutput(const char *path)
+{
+    m_Outputs.push_back({ m_OutputFormat, path, NULL, NULL, 0 });
+}
+
+void CN64Sig::SetCachePath(const char *path)
+{
+    m_CachePath = path;
+}
+
 int stricmp(const char* a, const char *b)
 {
     size_t alen = strlen(a);
@@ -76,17 +101,31 @@ bool CN64Sig::Run()
 {
     m_NumProcessedSymbols = 0;
 
-    printf("# sig_v1\n\n");
+    if(m_CachePath != NULL)
+    {
+        LoadCache(m_CachePath);
+    }
 
     for(auto libPath : m_LibPaths)
     {
         ScanRecursive(libPath);
     }
 
-    if(m_bVerbose)
+    for(auto elfPath : m_ElfPaths)
+    {
+        ProcessLinkedElf(elfPath);
+    }
+
+    ProcessObjects();
+
+    if(m_CachePath != NULL && !SaveCache(m_CachePath))
+    {
+        printf("Error: Failed to write cache '%s'\n", m_CachePath);
+    }
+
+    for(auto sigPath : m_SigPaths)
     {
-        printf("# %zu symbols\n", m_SymbolMap.size());
-        printf("# %zu processed\n", m_NumProcessedSymbols);
+        ProcessSignatureFile(sigPath);
     }
 
     // copy symbol map to into a vector and sort it by symbol name
@@ -98,106 +137,333 @@ bool CN64Sig::Run()
         symbols.push_back(i.second);
     }
 
-    std::sort(symbols.begin(), symbols.end(), [](symbol_entry_t& a, symbol_entry_t& b){
-        return stricmp(strPastUnderscores(a.name), strPastUnderscores(b.name)) < 0;
+    TrimPrefixes(symbols);
+    ComputeStats(symbols);
+
+    std::sort(symbols.begin(), symbols.end(), [this](symbol_entry_t& a, symbol_entry_t& b){
+        return stricmp(strPastUnderscores(m_Strings.Get(a.name)), strPastUnderscores(m_Strings.Get(b.name))) < 0;
     });
 
-    if(m_OutputFormat == N64SIG_FMT_DEFAULT)
+    if(m_Outputs.size() == 0)
     {
-        for(auto& symbolEntry : symbols)
+        m_Outputs.push_back({ m_OutputFormat, NULL, NULL, NULL, 0 });
+    }
+
+    bool bResult = true;
+
+    // every output is written in the same pass over the symbol table
+
+    for(auto& output : m_Outputs)
+    {
+        output.file = stdout;
+        output.writer = NULL;
+        output.numSymbolsWritten = 0;
+
+        if(output.path != NULL)
         {
-            printf("%s 0x%04X 0x%08X 0x%08X\n",
-                symbolEntry.name,
-                symbolEntry.size,
-                symbolEntry.crc_a,
-                symbolEntry.crc_b);
+            output.file = fopen(output.path, "wb");
 
-            if(symbolEntry.relocs == NULL)
+            if(output.file == NULL)
             {
+                printf("Error: Failed to open '%s' for writing\n", output.path);
+                bResult = false;
                 continue;
             }
+        }
+
+        output.writer = new CBufferedWriter(output.file);
+        WriteHeader(output);
+    }
 
-            for(auto& j : *symbolEntry.relocs)
+    for(auto& symbolEntry : symbols)
+    {
+        for(auto& output : m_Outputs)
+        {
+            if(output.writer != NULL)
             {
-                const reloc_entry_t& relocEntry = j.first;
-                const std::vector<uint16_t>& offsets = j.second;
+                WriteSymbol(output, symbolEntry);
+            }
+        }
 
-                printf(" .%-6s %s",
-                    GetRelTypeName(relocEntry.relocType),
-                    relocEntry.relocSymbolName);
+        delete symbolEntry.relocs;
+    }
 
-                for(auto& offset : offsets)
-                {
-                    printf(" 0x%03X", offset);
-                }
+    for(auto& output : m_Outputs)
+    {
+        if(output.writer == NULL)
+        {
+            continue;
+        }
+
+        WriteFooter(output);
+
+        if(!output.writer->Flush())
+        {
+            printf("Error: Failed to write '%s'\n", output.path != NULL ? output.path : "stdout");
+            bResult = false;
+        }
+
+        delete output.writer;
+        output.writer = NULL;
+
+        if(output.file != stdout)
+        {
+            fclose(output.file);
+        }
+    }
+
+    return bResult;
+}
+
+void CN64Sig::WriteHeader(output_target_t& output)
+{
+    CBufferedWriter *out = output.writer;
+
+    if(output.format == N64SIG_FMT_DEFAULT)
+    {
+        out->WriteString("# sig_v1\n\n");
+
+        if(m_bVerbose)
+        {
+            out->Printf("# %zu symbols\n", m_SymbolMap.size());
+            out->Printf("# %zu processed\n", m_NumProcessedSymbols);
+            out->Printf("# %zu objects cached\n", m_NumCachedObjects);
+        }
+    }
+    else if(output.format == N64SIG_FMT_JSON)
+    {
+        out->WriteString("[\n");
+    }
+}
+
+void CN64Sig::WriteFooter(output_target_t& output)
+{
+    if(output.format == N64SIG_FMT_JSON)
+    {
+        output.writer->WriteString("]");
+    }
+}
+
+void CN64Sig::WriteSymbol(output_target_t& output, const symbol_entry_t& symbolEntry)
+{
+    if(output.format == N64SIG_FMT_DEFAULT)
+    {
+        WriteDefaultSymbol(output.writer, symbolEntry);
+    }
+    else if(output.format == N64SIG_FMT_JSON)
+    {
+        if(!WriteJsonSymbol(output.writer, symbolEntry, output.numSymbolsWritten == 0))
+        {
+            return;
+        }
+    }
+
+    output.numSymbolsWritten++;
+}
+
+void CN64Sig::GetSortedRelocs(const symbol_entry_t& symbolEntry, sorted_relocs_t& sorted)
+{
+    // relocations are written in name order, independent of interning order
+    sorted.clear();
+
+    for(auto& i : *symbolEntry.relocs)
+    {
+        sorted.push_back(&i);
+    }
+
+    std::sort(sorted.begin(), sorted.end(), [this](const reloc_map_t::value_type *a, const reloc_map_t::value_type *b){
+        int t = strcmp(m_Strings.Get(a->first.relocSymbolName), m_Strings.Get(b->first.relocSymbolName));
+        if(t == 0)
+        {
+            return a->first.relocType < b->first.relocType;
+        }
+        return t < 0;
+    });
+}
+
+void CN64Sig::WriteDefaultSymbol(CBufferedWriter *out, const symbol_entry_t& symbolEntry)
+{
+    out->Printf("%s 0x%04X 0x%08X 0x%08X\n",
+        m_Strings.Get(symbolEntry.name),
+        symbolEntry.size,
+        symbolEntry.crc_a,
+        symbolEntry.crc_b);
+
+    if(symbolEntry.is_data)
+    {
+        out->Printf(" .%s\n", "object");
+    }
 
-                printf("\n");
+    if(symbolEntry.library != 0)
+    {
+        out->Printf(" .%-6s %s\n", "library", m_Strings.Get(symbolEntry.library));
+    }
+
+    if(symbolEntry.crc_a_shared != 0 || symbolEntry.prefix_shared != 0 || symbolEntry.low_entropy)
+    {
+        out->Printf(" .%-6s %u %u %u\n", "stats",
+            symbolEntry.crc_a_shared, symbolEntry.prefix_shared, symbolEntry.low_entropy ? 1 : 0);
+    }
+
+    for(size_t nAlias = 0; nAlias < symbolEntry.aliases.size(); nAlias++)
+    {
+        out->Printf(" .%-6s %s\n", "alias", m_Strings.Get(symbolEntry.aliases[nAlias]));
+
+        // group the renamed relocations by name, in name order
+        std::map<std::string, std::vector<uint16_t>> renamed;
+
+        for(auto& i : symbolEntry.alias_relocs[nAlias])
+        {
+            renamed[m_Strings.Get(i.second)].push_back(i.first);
+        }
+
+        for(auto& i : renamed)
+        {
+            out->Printf(" .%-6s %s", "relname", i.first.c_str());
+
+            for(auto& offset : i.second)
+            {
+                out->Printf(" 0x%03X", offset);
             }
 
-            delete symbolEntry.relocs;
+            out->WriteString("\n");
+        }
+    }
+
+    if(symbolEntry.prefix_words.size() != 0)
+    {
+        out->Printf(" .%-6s", "prefix");
+
+        for(auto& word : symbolEntry.prefix_words)
+        {
+            out->Printf(" 0x%08X", word);
+        }
+
+        out->WriteString("\n");
+    }
+
+    if(symbolEntry.block_size != 0)
+    {
+        out->Printf(" .%-6s 0x%02X", "blocks", symbolEntry.block_size);
 
-            printf("\n");
+        for(auto& blockCrc : symbolEntry.block_crcs)
+        {
+            out->Printf(" 0x%08X", blockCrc);
         }
+
+        out->WriteString("\n");
+    }
+
+    if(symbolEntry.relocs == NULL)
+    {
+        return;
     }
-    else if(m_OutputFormat == N64SIG_FMT_JSON)
+
+    sorted_relocs_t sortedRelocs;
+    GetSortedRelocs(symbolEntry, sortedRelocs);
+
+    for(auto j : sortedRelocs)
     {
+        const reloc_entry_t& relocEntry = j->first;
+        const std::vector<uint16_t>& offsets = j->second;
+
+        out->Printf(" .%-6s %s",
+            GetRelTypeName(relocEntry.relocType),
+            m_Strings.Get(relocEntry.relocSymbolName));
+
+        for(auto& offset : offsets)
+        {
+            out->Printf(" 0x%03X", offset);
+        }
+
+        out->WriteString("\n");
+    }
+
+    out->WriteString("\n");
+}
+
+bool CN64Sig::WriteJsonSymbol(CBufferedWriter *out, const symbol_entry_t& symbolEntry, bool bFirstSymbol)
+{
 /*
 ["alCSPNew", 0x016C, 0x3DEB8DFE 0x8E97D34A, [
     ["targ26", "__initChanState", [0x0A4]],
     ["targ26", "alEvtqNew", [0x12C]]
-]]
+], ["aliasName", ...]]
 */
-        printf("[\n");
+    if(symbolEntry.is_data)
+    {
+        // the web scanner tests every entry as a function, data objects are not written
+        return false;
+    }
 
-        bool bFirstSymbol = true;
-        for(auto& symbolEntry : symbols)
-        {
-            printf("%s  [\"%s\", %u, %u, %u, [",
-                (bFirstSymbol ? "" : ",\n"),
-                symbolEntry.name,
-                symbolEntry.size,
-                symbolEntry.crc_a,
-                symbolEntry.crc_b);
+    out->Printf("%s  [\"%s\", %u, %u, %u, [",
+        (bFirstSymbol ? "" : ",\n"),
+        m_Strings.Get(symbolEntry.name),
+        symbolEntry.size,
+        symbolEntry.crc_a,
+        symbolEntry.crc_b);
 
-            if(symbolEntry.relocs == NULL)
-            {
-                printf("]]");
-                continue;
-            }
+    if(symbolEntry.relocs == NULL)
+    {
+        out->WriteString("]]");
+        return true;
+    }
 
-            printf("\n");
+    out->WriteString("\n");
 
-            bool bFirstReloc = true;
-            for(auto& i : *symbolEntry.relocs)
-            {
-                const reloc_entry_t& relocEntry = i.first;
-                const std::vector<uint16_t>& offsets = i.second;
+    sorted_relocs_t sortedRelocs;
+    GetSortedRelocs(symbolEntry, sortedRelocs);
 
-                printf("%s    [\"%s\", \"%s\", [",
-                    (bFirstReloc ? "" : ",\n"),
-                    GetRelTypeName(relocEntry.relocType),
-                    relocEntry.relocSymbolName);
+    bool bFirstReloc = true;
+    for(auto i : sortedRelocs)
+    {
+        const reloc_entry_t& relocEntry = i->first;
+        const std::vector<uint16_t>& offsets = i->second;
 
-                bool bFirstOffset = true;
-                for(auto& offset : offsets)
-                {
-                    printf("%s%d", (bFirstOffset ? "" : ", "), offset);
-                    bFirstOffset = false;
-                }
+        out->Printf("%s    [\"%s\", \"%s\", [",
+            (bFirstReloc ? "" : ",\n"),
+            GetRelTypeName(relocEntry.relocType),
+            m_Strings.Get(relocEntry.relocSymbolName));
 
-                printf("]]");
-                bFirstReloc = false;
-            }
+        bool bFirstOffset = true;
+        for(auto& offset : offsets)
+        {
+            out->Printf("%s%d", (bFirstOffset ? "" : ", "), offset);
+            bFirstOffset = false;
+        }
+
+        out->WriteString("]]");
+        bFirstReloc = false;
+    }
 
-            printf("\n  ]]");
-            bFirstSymbol = false;
+    out->WriteString("\n  ]");
+
+    // relocation name variants are not written, only the distinct names
+    std::vector<uint32_t> aliases;
+
+    for(auto alias : symbolEntry.aliases)
+    {
+        if(alias != symbolEntry.name && std::find(aliases.begin(), aliases.end(), alias) == aliases.end())
+        {
+            aliases.push_back(alias);
         }
-        
-        printf("]");
     }
 
-    
+    if(aliases.size() != 0)
+    {
+        out->WriteString(", [");
+
+        bool bFirstAlias = true;
+        for(auto& alias : aliases)
+        {
+            out->Printf("%s\"%s\"", (bFirstAlias ? "" : ", "), m_Strings.Get(alias));
+            bFirstAlias = false;
+        }
+
+        out->WriteString("]");
+    }
 
+    out->WriteString("]");
     return true;
 }
 
@@ -208,6 +474,8 @@ const char *CN64Sig::GetRelTypeName(uint8_t relType)
     case R_MIPS_26: return "targ26";
     case R_MIPS_LO16: return "lo16";
     case R_MIPS_HI16: return "hi16";
+    case R_MIPS_32: return "abs32";
+    case R_MIPS_GPREL16: return "gprel16";
     }
 
     return NULL;
@@ -225,34 +493,39 @@ void CN64Sig::FormatAnonymousSymbol(char *symbolName)
     }
 }
 
-void CN64Sig::StripAndGetRelocsInSymbol(const char *objectName, reloc_map_t& relocs, CElfSymbol *symbol, CElfContext& elf)
+void CN64Sig::StripAndGetRelocsInSymbol(obj_processing_context_t *objProcessingCtx, reloc_map_t& relocs, CElfSymbol *symbol, CElfContext& elf, object_tables_t& tables)
 {
-    int numTextRelocations = elf.NumTextRelocations();
+    const char *objectName = objProcessingCtx->objectName;
     uint32_t symbolOffset = symbol->Value();
     uint32_t symbolSize = symbol->Size();
 
+    const reloc_table_t& textRelocs = tables.text.relocs;
+
+    // visit the relocations in table order so that each HI16 is still followed by its LO16
+    std::vector<uint32_t> symbolRelocs;
+    GetRelocsInRange(textRelocs, symbolOffset, symbolSize, symbolRelocs);
+
     uint32_t lastHi16Addend = 0;
 
-    for(int nRel = 0; nRel < numTextRelocations; nRel++)
+    for(auto nRel : symbolRelocs)
     {
-        CElfRelocation *relocation = elf.TextRelocation(nRel);
+        CElfRelocation *relocation = &textRelocs.relocs[nRel];
 
         uint32_t relOffset = relocation->Offset();
 
-        if(relOffset < symbolOffset || relOffset >= symbolOffset + symbolSize)
+        char relSymbolName[512] = "";
+
+        if(relocation->SymbolIndex() >= tables.numSymbols)
         {
             continue;
         }
 
-        char relSymbolName[128];
-
-        CElfSymbol *relSymbol = relocation->Symbol(&elf);
-        strncpy(relSymbolName, relSymbol->Name(&elf), sizeof(relSymbolName) - 1);
+        CElfSymbol *relSymbol = &tables.symbols[relocation->SymbolIndex()];
+        strncpy(relSymbolName, &tables.strTab[relSymbol->NameOffset()], sizeof(relSymbolName) - 1);
         uint8_t relType = relocation->Type();
         //const char *relTypeName = GetRelTypeName(relocation->Type());
 
-        const uint8_t *textData = (const uint8_t *)elf.Section(".text")->Data(&elf);
-        uint8_t *opcode = (uint8_t *) &textData[relocation->Offset()];
+        uint8_t *opcode = &tables.text.data[relocation->Offset()];
         reloc_entry_t relocEntry;
         //relocEntry.param = 0;
 
@@ -264,15 +537,16 @@ void CN64Sig::StripAndGetRelocsInSymbol(const char *objectName, reloc_map_t& rel
             if(relType == R_MIPS_HI16)
             {
                 addend = (opcodeBE & 0xFFFF) << 16;
-                CElfRelocation *relocation2 = elf.TextRelocation(nRel + 1); // todo guard
-
-                // next relocation must be LO16
-                if(relocation2->Type() != R_MIPS_LO16)
+                // next relocation must be LO16, the addend can't be known otherwise
+                if(nRel + 1 >= textRelocs.offsets.size() ||
+                   textRelocs.relocs[nRel + 1].Type() != R_MIPS_LO16)
                 {
-                    exit(EXIT_FAILURE);
+                    objProcessingCtx->numUnhandledRelocs++;
+                    continue;
                 }
 
-                uint8_t *opcode2 = (uint8_t*) &textData[relocation2->Offset()];
+                CElfRelocation *relocation2 = &textRelocs.relocs[nRel + 1];
+                uint8_t *opcode2 = &tables.text.data[relocation2->Offset()];
                 uint32_t opcode2BE = bswap32(*(uint32_t*)opcode2);
 
                 addend += (int16_t)(opcode2BE & 0xFFFF);
@@ -311,132 +585,1357 @@ void CN64Sig::StripAndGetRelocsInSymbol(const char *objectName, reloc_map_t& rel
         }
         else
         {
-            printf("# warning unhandled relocation type\n");
+            objProcessingCtx->numUnhandledRelocs++;
             continue;
             //printf("unk rel %d\n", relType);
             //exit(0);
         }
 
         relocEntry.relocType = relType;
-        strncpy(relocEntry.relocSymbolName, relSymbolName, sizeof(relocEntry.relocSymbolName));
+        relocEntry.relocSymbolName = objProcessingCtx->mt_this->m_Strings.Intern(relSymbolName);
 
         relocs[relocEntry].push_back(relOffset - symbolOffset);
     }
 }
 
-void CN64Sig::ProcessLibrary(const char *path)
+void CN64Sig::StripAndGetRelocsInData(obj_processing_context_t *objProcessingCtx, reloc_map_t& relocs, CElfSymbol *symbol, CElfContext& elf, object_tables_t& tables, section_tables_t& section)
 {
-    CArReader arReader;
-    CElfContext elf;
+    const char *objectName = objProcessingCtx->objectName;
+    uint32_t symbolOffset = symbol->Value();
+    uint32_t symbolSize = symbol->Size();
 
-    if(!arReader.Load(path))
-    {
-        return;
-    }
+    std::vector<uint32_t> symbolRelocs;
+    GetRelocsInRange(section.relocs, symbolOffset, symbolSize, symbolRelocs);
 
-    while(arReader.SeekNextBlock())
+    for(auto nRel : symbolRelocs)
     {
-        const char *blockId = arReader.GetBlockIdentifier();
-        uint8_t    *objectData = arReader.GetBlockData();
-        size_t      objectSize = arReader.GetBlockSize();
+        CElfRelocation *relocation = &section.relocs.relocs[nRel];
+        uint32_t relOffset = relocation->Offset();
 
-        if(!PathIsObjectFile(blockId))
+        // only whole-word pointers are expected in data
+        if(relocation->Type() != R_MIPS_32 || relOffset + 4 > symbolOffset + symbolSize ||
+           relocation->SymbolIndex() >= tables.numSymbols)
         {
+            objProcessingCtx->numUnhandledRelocs++;
             continue;
         }
 
-        char objectName[256];
-        PathGetFileName(blockId, objectName, sizeof(objectName));
+        char relSymbolName[512] = "";
+
+        CElfSymbol *relSymbol = &tables.symbols[relocation->SymbolIndex()];
+        strncpy(relSymbolName, &tables.strTab[relSymbol->NameOffset()], sizeof(relSymbolName) - 1);
+
+        uint8_t *word = &section.data[relOffset];
+
+        if(relSymbol->Binding() == STB_LOCAL) // anonymous symbol
+        {
+            uint32_t addend = bswap32(*(uint32_t*)word);
+            const char *relSymbolSectionName = elf.Section(relSymbol->SectionIndex())->Name(&elf);
+            snprintf(relSymbolName, sizeof(relSymbolName), "%s_%s_%04X", objectName, &relSymbolSectionName[1], addend);
+        }
+
+        memset(word, 0, 4);
 
-        elf.LoadFromMemory(objectData, objectSize);
+        reloc_entry_t relocEntry;
+        relocEntry.relocType = R_MIPS_32;
+        relocEntry.relocSymbolName = objProcessingCtx->mt_this->m_Strings.Intern(relSymbolName);
 
-        ProcessObject(elf, objectName);
+        relocs[relocEntry].push_back(relOffset - symbolOffset);
     }
 }
 
-void CN64Sig::ProcessObject(CElfContext& elf, const char *objectName)
+void CN64Sig::LoadSectionTables(CElfContext& elf, const char *name, section_tables_t& section)
 {
-    //printf("# object: %s\n", objectName);
+    section.sectionIndex = -1;
+    section.data = NULL;
+    section.relocs.relocs = NULL;
+
+    if(!elf.SectionIndexOf(name, &section.sectionIndex))
+    {
+        section.sectionIndex = -1;
+        return;
+    }
 
-    CElfSection *textSection;
-    const uint8_t *textData;
-    int indexOfText;
+    section.data = (uint8_t *)elf.Section(section.sectionIndex)->Data(&elf);
 
-    // todo rename IndexOfSection
-    if(!elf.SectionIndexOf(".text", &indexOfText))
+    char relSectionName[64];
+    snprintf(relSectionName, sizeof(relSectionName), ".rel%s", name);
+    CElfSection *relSection = elf.Section(relSectionName);
+
+    if(relSection == NULL)
     {
         return;
     }
 
-    textSection = elf.Section(indexOfText);
-    textData = (const uint8_t*)textSection->Data(&elf);
+    reloc_table_t& table = section.relocs;
+    size_t numRelocs = relSection->Size() / sizeof(CElfRelocation);
+    table.relocs = (CElfRelocation *)relSection->Data(&elf);
+
+    for(size_t nRel = 0; nRel < numRelocs; nRel++)
+    {
+        table.byOffset.push_back(nRel);
+    }
 
-    int numSymbols = elf.NumSymbols();
+    std::stable_sort(table.byOffset.begin(), table.byOffset.end(), [&table](uint32_t a, uint32_t b){
+        return table.relocs[a].Offset() < table.relocs[b].Offset();
+    });
 
-    for(int nSymbol = 0; nSymbol < numSymbols; nSymbol++)
+    for(auto nRel : table.byOffset)
     {
-        CElfSymbol *symbol = elf.Symbol(nSymbol);
+        table.offsets.push_back(table.relocs[nRel].Offset());
+    }
+}
 
-        int         symbolSectionIndex = symbol->SectionIndex();
-        const char* symbolName = symbol->Name(&elf);
-        uint8_t     symbolType = symbol->Type();
-        uint32_t    symbolSize = symbol->Size();
-        uint32_t    symbolOffset = symbol->Value();
+void CN64Sig::GetRelocsInRange(const reloc_table_t& table, uint32_t offset, uint32_t size, std::vector<uint32_t>& relocs)
+{
+    // returns the indices of the relocations in [offset, offset + size), in table order
+    auto relocsStart = std::lower_bound(table.offsets.begin(), table.offsets.end(), offset);
+    auto relocsEnd = std::lower_bound(relocsStart, table.offsets.end(), offset + size);
 
-        if(symbolSectionIndex != indexOfText ||
-           symbolType != STT_FUNC ||
-           symbolSize == 0)
-        {
-            continue;
-        }
+    relocs.assign(
+        table.byOffset.begin() + (relocsStart - table.offsets.begin()),
+        table.byOffset.begin() + (relocsEnd - table.offsets.begin()));
 
-        symbol_entry_t symbolEntry;
-        strncpy(symbolEntry.name, symbolName, sizeof(symbolEntry.name) - 1);
-        symbolEntry.relocs = new reloc_map_t;
+    std::sort(relocs.begin(), relocs.end());
+}
 
-        StripAndGetRelocsInSymbol(objectName, *symbolEntry.relocs, symbol, elf);
+void CN64Sig::ProcessLibrary(const char *path)
+{
+    CArReader arReader;
 
-        symbolEntry.size = symbolSize;
-        symbolEntry.crc_a = crc32(&textData[symbolOffset], min(symbolSize, 8));
-        symbolEntry.crc_b = crc32(&textData[symbolOffset], symbolSize);
+    if(!arReader.Load(path))
+    {
+        return;
+    }
 
-        m_NumProcessedSymbols++;
+    while(arReader.SeekNextBlock())
+    {
+        const char *blockId = arReader.GetBlockIdentifier();
+        uint8_t    *objectData = arReader.GetBlockData();
+        size_t      objectSize = arReader.GetBlockSize();
 
-        if(m_SymbolMap.count(symbolEntry.crc_b) != 0)
+        if(!PathIsObjectFile(blockId))
         {
-            if(m_bVerbose)
-            {
-                if(strcmp(symbolEntry.name, m_SymbolMap[symbolEntry.crc_b].name) != 0)
-                {
-                    printf("# warning: skipped %s (have %s, crc: %08X)\n",
-                        symbolEntry.name,
-                        m_SymbolMap[symbolEntry.crc_b].name,
-                        symbolEntry.crc_b);
-                }
-            }
-
-            delete symbolEntry.relocs;
             continue;
         }
 
-        m_SymbolMap[symbolEntry.crc_b] = symbolEntry;
+        // the archive buffer is freed on return, keep a copy for the worker
+        obj_processing_context_t *objProcessingCtx = new obj_processing_context_t;
+        objProcessingCtx->mt_this = this;
+        objProcessingCtx->linkedElf = NULL;
+        PathGetFileName(blockId, objProcessingCtx->objectName, sizeof(objProcessingCtx->objectName));
+        PathGetFileName(path, objProcessingCtx->libraryName, sizeof(objProcessingCtx->libraryName));
+        objProcessingCtx->data = new uint8_t[objectSize];
+        objProcessingCtx->size = objectSize;
+        objProcessingCtx->numUnhandledRelocs = 0;
+        memcpy(objProcessingCtx->data, objectData, objectSize);
+        objProcessingCtx->hash = HashObject(objProcessingCtx->objectName, objectData, objectSize);
+
+        m_Objects.push_back(objProcessingCtx);
     }
 }
 
-void CN64Sig::ProcessObject(const char *path)
+void CN64Sig::ProcessObjects()
 {
-    char objectName[256];
-    PathGetFileName(path, objectName, sizeof(objectName));
+    // symbols are collected per object in parallel, then added in input order
+    // so that the output matches a serial run
 
-    CElfContext elf;
-    if(elf.Load(path))
+    // objects that are unchanged since the cache was written are not processed again
+    std::vector<bool> cached(m_Objects.size(), false);
+
+    for(size_t i = 0; i < m_Objects.size(); i++)
     {
-        ProcessObject(elf, objectName);
+        obj_processing_context_t *objProcessingCtx = m_Objects[i];
+        auto cacheEntry = m_Cache.find(objProcessingCtx->hash);
+
+        if(cacheEntry != m_Cache.end() &&
+           DeserializeSymbols(objProcessingCtx, m_BlockSize, cacheEntry->second))
+        {
+            cached[i] = true;
+            m_NumCachedObjects++;
+            continue;
+        }
+
+        m_ThreadPool.AddWorker(ProcessObjectProc, (void*)objProcessingCtx);
     }
-}
 
-void CN64Sig::ProcessFile(const char *path)
-{
+    m_ThreadPool.WaitForWorkers();
+
+    // only keep cache entries for the objects seen in this run
+    std::map<uint64_t, std::string> usedCache;
+
+    for(size_t i = 0; i < m_Objects.size(); i++)
+    {
+        obj_processing_context_t *objProcessingCtx = m_Objects[i];
+
+        if(m_CachePath != NULL && usedCache.count(objProcessingCtx->hash) == 0)
+        {
+            if(cached[i])
+            {
+                usedCache[objProcessingCtx->hash].swap(m_Cache[objProcessingCtx->hash]);
+            }
+            else
+            {
+                SerializeSymbols(objProcessingCtx, m_BlockSize, usedCache[objProcessingCtx->hash]);
+            }
+        }
+
+        for(size_t nWarning = 0; nWarning < objProcessingCtx->numUnhandledRelocs; nWarning++)
+        {
+            printf("# warning unhandled relocation type\n");
+        }
+
+        uint32_t library = m_Strings.Intern(objProcessingCtx->libraryName);
+
+        for(auto& symbolEntry : objProcessingCtx->symbols)
+        {
+            m_NumProcessedSymbols++;
+            symbolEntry.library = library;
+            AddSymbol(symbolEntry);
+        }
+
+        delete[] objProcessingCtx->data;
+        delete objProcessingCtx;
+    }
+
+    m_Objects.clear();
+    m_Cache.swap(usedCache);
+
+    for(auto linkedElf : m_LinkedElfs)
+    {
+        delete linkedElf;
+    }
+
+    m_LinkedElfs.clear();
+}
+
+void *CN64Sig::ProcessObjectProc(void *_objProcessingCtx)
+{
+    obj_processing_context_t *objProcessingCtx = (obj_processing_context_t *)_objProcessingCtx;
+    objProcessingCtx->mt_this->ProcessObject(objProcessingCtx);
+    return NULL;
+}
+
+void CN64Sig::ProcessObject(obj_processing_context_t *objProcessingCtx)
+{
+    if(objProcessingCtx->linkedElf != NULL)
+    {
+        ProcessLinkedFunctions(objProcessingCtx);
+        return;
+    }
+
+    CElfContext elf;
+    elf.LoadFromMemory(objProcessingCtx->data, objProcessingCtx->size);
+
+    // Section(name) is a linear search, look the tables up once
+    CElfSection *symTabSection = elf.Section(".symtab");
+    CElfSection *strTabSection = elf.Section(".strtab");
+
+    if(symTabSection == NULL || strTabSection == NULL)
+    {
+        return;
+    }
+
+    object_tables_t tables;
+    tables.symbols = (CElfSymbol *)symTabSection->Data(&elf);
+    tables.numSymbols = symTabSection->Size() / sizeof(CElfSymbol);
+    tables.strTab = strTabSection->Data(&elf);
+
+    LoadSectionTables(elf, ".text", tables.text);
+    LoadSectionTables(elf, ".data", tables.data);
+    LoadSectionTables(elf, ".rodata", tables.rodata);
+
+    for(size_t nSymbol = 0; nSymbol < tables.numSymbols; nSymbol++)
+    {
+        CElfSymbol *symbol = &tables.symbols[nSymbol];
+
+        int         symbolSectionIndex = symbol->SectionIndex();
+        const char* symbolName = &tables.strTab[symbol->NameOffset()];
+        uint8_t     symbolType = symbol->Type();
+        uint32_t    symbolSize = symbol->Size();
+        uint32_t    symbolOffset = symbol->Value();
+
+        if(symbolSize == 0)
+        {
+            continue;
+        }
+
+        symbol_entry_t symbolEntry;
+        symbolEntry.name = m_Strings.Intern(symbolName);
+        symbolEntry.size = symbolSize;
+        symbolEntry.library = 0;
+        symbolEntry.crc_a_shared = 0;
+        symbolEntry.prefix_shared = 0;
+
+        if(symbolType == STT_FUNC && symbolSectionIndex == tables.text.sectionIndex)
+        {
+            symbolEntry.relocs = new reloc_map_t;
+            symbolEntry.is_data = false;
+            StripAndGetRelocsInSymbol(objProcessingCtx, *symbolEntry.relocs, symbol, elf, tables);
+            AddObjectSymbol(objProcessingCtx, symbolEntry, &tables.text.data[symbolOffset]);
+        }
+        else if(symbolType == STT_OBJECT &&
+            (symbolSectionIndex == tables.data.sectionIndex || symbolSectionIndex == tables.rodata.sectionIndex))
+        {
+            section_tables_t& section = (symbolSectionIndex == tables.data.sectionIndex) ? tables.data : tables.rodata;
+            symbolEntry.relocs = new reloc_map_t;
+            symbolEntry.is_data = true;
+            StripAndGetRelocsInData(objProcessingCtx, *symbolEntry.relocs, symbol, elf, tables, section);
+            AddObjectSymbol(objProcessingCtx, symbolEntry, &section.data[symbolOffset]);
+        }
+    }
+}
+
+void CN64Sig::AddObjectSymbol(obj_processing_context_t *objProcessingCtx, symbol_entry_t& symbolEntry, const uint8_t *symbolData)
+{
+    // symbolData has its relocations stripped
+    uint32_t symbolSize = symbolEntry.size;
+
+    symbolEntry.crc_a = crc32(symbolData, min(symbolSize, 8));
+    symbolEntry.crc_b = crc32(symbolData, symbolSize);
+    symbolEntry.block_size = m_BlockSize;
+    symbolEntry.low_entropy = IsLowEntropy(symbolData, symbolSize);
+
+    for(uint32_t i = 0; i < symbolSize / 4 && i < N64SIG_MAX_PREFIX_WORDS; i++)
+    {
+        symbolEntry.prefix_words.push_back(bswap32(*(uint32_t*)&symbolData[i * 4]));
+    }
+
+    if(m_BlockSize != 0)
+    {
+        for(uint32_t blockOffset = 0; blockOffset < symbolSize; blockOffset += m_BlockSize)
+        {
+            uint32_t blockSize = min(m_BlockSize, symbolSize - blockOffset);
+            symbolEntry.block_crcs.push_back(crc32(&symbolData[blockOffset], blockSize));
+        }
+    }
+
+    objProcessingCtx->symbols.push_back(symbolEntry);
+}
+
+void CN64Sig::TrimPrefixes(std::vector<symbol_entry_t>& symbols)
+{
+    // shorten each prefix to the fewest words that no other signature starts with
+
+    std::vector<symbol_entry_t *> sorted;
+
+    for(auto& symbolEntry : symbols)
+    {
+        sorted.push_back(&symbolEntry);
+    }
+
+    std::sort(sorted.begin(), sorted.end(), [](symbol_entry_t *a, symbol_entry_t *b){
+        return a->prefix_words < b->prefix_words;
+    });
+
+    // number of leading words shared by neighbours
+    std::vector<size_t> common(sorted.size() + 1, 0);
+
+    for(size_t i = 1; i < sorted.size(); i++)
+    {
+        const std::vector<uint32_t>& a = sorted[i - 1]->prefix_words;
+        const std::vector<uint32_t>& b = sorted[i]->prefix_words;
+        size_t n = 0;
+
+        while(n < a.size() && n < b.size() && a[n] == b[n])
+        {
+            n++;
+        }
+
+        common[i] = n;
+    }
+
+    for(size_t i = 0; i < sorted.size(); i++)
+    {
+        std::vector<uint32_t>& words = sorted[i]->prefix_words;
+        size_t numWords = std::max(common[i], common[i + 1]) + 1;
+
+        if(numWords < words.size())
+        {
+            words.resize(numWords);
+        }
+    }
+}
+
+void CN64Sig::ComputeStats(std::vector<symbol_entry_t>& symbols)
+{
+    // count how many other signatures each one can be confused with
+
+    std::map<std::pair<bool, uint32_t>, uint32_t> crcACounts;
+
+    for(auto& symbolEntry : symbols)
+    {
+        crcACounts[{ symbolEntry.is_data, symbolEntry.crc_a }]++;
+    }
+
+    for(auto& symbolEntry : symbols)
+    {
+        symbolEntry.crc_a_shared = crcACounts[{ symbolEntry.is_data, symbolEntry.crc_a }] - 1;
+    }
+
+    // signatures that start with a symbol's prefix sort directly after it,
+    // equal prefixes are adjacent on either side
+
+    std::vector<symbol_entry_t *> sorted;
+
+    for(auto& symbolEntry : symbols)
+    {
+        sorted.push_back(&symbolEntry);
+    }
+
+    std::sort(sorted.begin(), sorted.end(), [](symbol_entry_t *a, symbol_entry_t *b){
+        if(a->is_data != b->is_data) return b->is_data;
+        return a->prefix_words < b->prefix_words;
+    });
+
+    for(size_t i = 0; i < sorted.size(); i++)
+    {
+        const std::vector<uint32_t>& prefix = sorted[i]->prefix_words;
+        uint32_t numShared = 0;
+
+        for(size_t j = i + 1; j < sorted.size(); j++)
+        {
+            const std::vector<uint32_t>& other = sorted[j]->prefix_words;
+
+            if(sorted[j]->is_data != sorted[i]->is_data || other.size() < prefix.size() ||
+               !std::equal(prefix.begin(), prefix.end(), other.begin()))
+            {
+                break;
+            }
+
+            numShared++;
+        }
+
+        for(size_t j = i; j > 0; j--)
+        {
+            if(sorted[j - 1]->is_data != sorted[i]->is_data || sorted[j - 1]->prefix_words != prefix)
+            {
+                break;
+            }
+
+            numShared++;
+        }
+
+        sorted[i]->prefix_shared = numShared;
+    }
+}
+
+bool CN64Sig::IsLowEntropy(const uint8_t *symbolData, uint32_t symbolSize)
+{
+    // symbolData has its relocations stripped
+    uint32_t distinct[N64SIG_LOW_ENTROPY_WORDS];
+    size_t numDistinct = 0;
+
+    for(uint32_t offset = 0; offset + 4 <= symbolSize; offset += 4)
+    {
+        uint32_t word = *(uint32_t*)&symbolData[offset];
+
+        if(std::find(distinct, distinct + numDistinct, word) != distinct + numDistinct)
+        {
+            continue;
+        }
+
+        distinct[numDistinct++] = word;
+
+        if(numDistinct == N64SIG_LOW_ENTROPY_WORDS)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void CN64Sig::GetSymbolKey(const symbol_entry_t& symbolEntry, symbol_key_t& key)
+{
+    key.size = symbolEntry.size;
+    key.crc_a = symbolEntry.crc_a;
+    key.crc_b = symbolEntry.crc_b;
+    key.is_data = symbolEntry.is_data;
+    key.relocLayout.clear();
+
+    if(symbolEntry.relocs != NULL)
+    {
+        for(auto& i : *symbolEntry.relocs)
+        {
+            for(auto& offset : i.second)
+            {
+                key.relocLayout.push_back((offset << 8) | i.first.relocType);
+            }
+        }
+    }
+
+    std::sort(key.relocLayout.begin(), key.relocLayout.end());
+}
+
+void CN64Sig::GetRelocNames(const symbol_entry_t& symbolEntry, reloc_names_t& names)
+{
+    names.clear();
+
+    if(symbolEntry.relocs == NULL)
+    {
+        return;
+    }
+
+    for(auto& i : *symbolEntry.relocs)
+    {
+        for(auto offset : i.second)
+        {
+            names[offset] = i.first.relocSymbolName;
+        }
+    }
+}
+
+void CN64Sig::AddSymbol(symbol_entry_t& symbolEntry)
+{
+    symbol_key_t key;
+    GetSymbolKey(symbolEntry, key);
+
+    auto existing = m_SymbolMap.find(key);
+
+    if(existing == m_SymbolMap.end())
+    {
+        m_SymbolMap[key] = symbolEntry;
+        return;
+    }
+
+    // same body, keep the new names as aliases of the existing entry
+    symbol_entry_t& haveEntry = existing->second;
+
+    if(haveEntry.block_size == 0 && symbolEntry.block_size != 0)
+    {
+        haveEntry.block_size = symbolEntry.block_size;
+        haveEntry.block_crcs = symbolEntry.block_crcs;
+    }
+
+    if(haveEntry.prefix_words.size() < symbolEntry.prefix_words.size())
+    {
+        haveEntry.prefix_words = symbolEntry.prefix_words;
+    }
+
+    if(haveEntry.library == 0)
+    {
+        haveEntry.library = symbolEntry.library;
+    }
+
+    haveEntry.low_entropy = haveEntry.low_entropy || symbolEntry.low_entropy;
+
+    // the relocation layouts are identical, only the names they target may differ
+
+    reloc_names_t haveRelocNames, newRelocNames;
+    GetRelocNames(haveEntry, haveRelocNames);
+    GetRelocNames(symbolEntry, newRelocNames);
+
+    for(size_t nName = 0; nName <= symbolEntry.aliases.size(); nName++)
+    {
+        uint32_t name = (nName == 0) ? symbolEntry.name : symbolEntry.aliases[nName - 1];
+        reloc_names_t relocNames = newRelocNames;
+
+        if(nName != 0)
+        {
+            for(auto& i : symbolEntry.alias_relocs[nName - 1])
+            {
+                relocNames[i.first] = i.second;
+            }
+        }
+
+        reloc_names_t renamed;
+
+        for(auto& i : relocNames)
+        {
+            if(haveRelocNames[i.first] != i.second)
+            {
+                renamed[i.first] = i.second;
+            }
+        }
+
+        bool bHave = (name == haveEntry.name && renamed.empty());
+
+        for(size_t nAlias = 0; nAlias < haveEntry.aliases.size() && !bHave; nAlias++)
+        {
+            bHave = (haveEntry.aliases[nAlias] == name && haveEntry.alias_relocs[nAlias] == renamed);
+        }
+
+        if(bHave)
+        {
+            continue;
+        }
+
+        if(m_bVerbose)
+        {
+            printf("# alias: %s (have %s, crc: %08X, %d renamed relocations)\n",
+                m_Strings.Get(name), m_Strings.Get(haveEntry.name), haveEntry.crc_b, (int)renamed.size());
+        }
+
+        haveEntry.aliases.push_back(name);
+        haveEntry.alias_relocs.push_back(renamed);
+    }
+
+    delete symbolEntry.relocs;
+}
+
+void CN64Sig::ProcessSignatureFile(const char *path)
+{
+    CSignatureFile sigFile;
+
+    // the object workers are done by now
+    if(!sigFile.Load(path, &m_ThreadPool))
+    {
+        printf("# error: failed to load %s\n", path);
+        return;
+    }
+
+    size_t numSymbols = sigFile.GetNumSymbols();
+
+    for(size_t nSymbol = 0; nSymbol < numSymbols; nSymbol++)
+    {
+        symbol_entry_t symbolEntry;
+        char symbolName[256];
+        sigFile.GetSymbolName(nSymbol, symbolName, sizeof(symbolName) - 1);
+        symbolName[sizeof(symbolName) - 1] = '\0';
+        symbolEntry.name = m_Strings.Intern(symbolName);
+        symbolEntry.size = sigFile.GetSymbolSize(nSymbol);
+        symbolEntry.is_data = sigFile.IsDataSymbol(nSymbol);
+        symbolEntry.low_entropy = sigFile.IsLowEntropySymbol(nSymbol);
+        symbolEntry.crc_a_shared = 0;
+        symbolEntry.prefix_shared = 0;
+        symbolEntry.library = 0;
+
+        char libraryName[256];
+        if(sigFile.GetSymbolLibrary(nSymbol, libraryName, sizeof(libraryName) - 1))
+        {
+            libraryName[sizeof(libraryName) - 1] = '\0';
+            symbolEntry.library = m_Strings.Intern(libraryName);
+        }
+        symbolEntry.crc_a = sigFile.GetSymbolCrcA(nSymbol);
+        symbolEntry.crc_b = sigFile.GetSymbolCrcB(nSymbol);
+        symbolEntry.relocs = new reloc_map_t;
+        symbolEntry.block_size = sigFile.GetBlockSize(nSymbol);
+
+        for(size_t nBlock = 0; nBlock < sigFile.GetNumBlocks(nSymbol); nBlock++)
+        {
+            symbolEntry.block_crcs.push_back(sigFile.GetBlockCrc(nSymbol, nBlock));
+        }
+
+        for(size_t nWord = 0; nWord < sigFile.GetNumPrefixWords(nSymbol); nWord++)
+        {
+            symbolEntry.prefix_words.push_back(sigFile.GetPrefixWord(nSymbol, nWord));
+        }
+
+        for(size_t nAlias = 0; nAlias < sigFile.GetNumAliases(nSymbol); nAlias++)
+        {
+            char aliasName[256];
+            sigFile.GetAliasName(nSymbol, nAlias, aliasName, sizeof(aliasName) - 1);
+            aliasName[sizeof(aliasName) - 1] = '\0';
+            symbolEntry.aliases.push_back(m_Strings.Intern(aliasName));
+
+            reloc_names_t renamed;
+
+            for(size_t nAliasReloc = 0; nAliasReloc < sigFile.GetNumAliasRelocs(nSymbol, nAlias); nAliasReloc++)
+            {
+                char relocName[256];
+                sigFile.GetAliasRelocName(nSymbol, nAlias, nAliasReloc, relocName, sizeof(relocName) - 1);
+                relocName[sizeof(relocName) - 1] = '\0';
+                renamed[sigFile.GetAliasRelocOffset(nSymbol, nAlias, nAliasReloc)] = m_Strings.Intern(relocName);
+            }
+
+            symbolEntry.alias_relocs.push_back(renamed);
+        }
+
+        for(size_t nReloc = 0; nReloc < sigFile.GetNumRelocs(nSymbol); nReloc++)
+        {
+            reloc_entry_t relocEntry;
+            memset(&relocEntry, 0, sizeof(relocEntry));
+            relocEntry.relocType = sigFile.GetRelocType(nSymbol, nReloc);
+            char relocName[256];
+            sigFile.GetRelocName(nSymbol, nReloc, relocName, sizeof(relocName) - 1);
+            relocName[sizeof(relocName) - 1] = '\0';
+            relocEntry.relocSymbolName = m_Strings.Intern(relocName);
+
+            (*symbolEntry.relocs)[relocEntry].push_back(sigFile.GetRelocOffset(nSymbol, nReloc));
+        }
+
+        m_NumProcessedSymbols++;
+
+        AddSymbol(symbolEntry);
+    }
+}
+
+uint64_t CN64Sig::HashObject(const char *objectName, const uint8_t *data, size_t size)
+{
+    // FNV-1a; the name is included because anonymous relocation names are derived from it
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    for(const char *c = objectName; *c != '\0'; c++)
+    {
+        hash = (hash ^ (uint8_t)*c) * 0x100000001B3ULL;
+    }
+
+    hash = (hash ^ 0) * 0x100000001B3ULL;
+
+    for(size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ data[i]) * 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+static void BlobPut(std::string& blob, const void *data, size_t size)
+{
+    blob.append((const char *)data, size);
+}
+
+static void BlobPutU32(std::string& blob, uint32_t value)
+{
+    BlobPut(blob, &value, sizeof(value));
+}
+
+static void BlobPutString(std::string& blob, const char *str)
+{
+    uint32_t length = strlen(str);
+    BlobPutU32(blob, length);
+    BlobPut(blob, str, length);
+}
+
+static bool BlobGet(const std::string& blob, size_t& pos, void *data, size_t size)
+{
+    if(size > blob.size() - pos)
+    {
+        return false;
+    }
+
+    memcpy(data, &blob[pos], size);
+    pos += size;
+    return true;
+}
+
+static bool BlobGetU32(const std::string& blob, size_t& pos, uint32_t *value)
+{
+    return BlobGet(blob, pos, value, sizeof(*value));
+}
+
+// false if the rest of the blob is too short for count elements, so that a corrupt count isn't allocated
+static bool BlobHasRoom(const std::string& blob, size_t pos, uint32_t count, size_t elementSize)
+{
+    return count <= (blob.size() - pos) / elementSize;
+}
+
+static bool BlobGetString(const std::string& blob, size_t& pos, std::string& str)
+{
+    uint32_t length;
+
+    if(!BlobGetU32(blob, pos, &length) || length > blob.size() - pos)
+    {
+        return false;
+    }
+
+    str.assign(blob, pos, length);
+    pos += length;
+    return true;
+}
+
+void CN64Sig::SerializeSymbols(obj_processing_context_t *objProcessingCtx, uint32_t blockSize, std::string& blob)
+{
+    CStringPool& strings = objProcessingCtx->mt_this->m_Strings;
+
+    BlobPutU32(blob, blockSize);
+    BlobPutU32(blob, objProcessingCtx->numUnhandledRelocs);
+    BlobPutU32(blob, objProcessingCtx->symbols.size());
+
+    for(auto& symbolEntry : objProcessingCtx->symbols)
+    {
+        BlobPutString(blob, strings.Get(symbolEntry.name));
+        BlobPutU32(blob, symbolEntry.size);
+        BlobPutU32(blob, symbolEntry.crc_a);
+        BlobPutU32(blob, symbolEntry.crc_b);
+        BlobPutU32(blob, symbolEntry.is_data);
+        BlobPutU32(blob, symbolEntry.low_entropy);
+
+        BlobPutU32(blob, symbolEntry.prefix_words.size());
+        BlobPut(blob, symbolEntry.prefix_words.data(), symbolEntry.prefix_words.size() * sizeof(uint32_t));
+
+        BlobPutU32(blob, symbolEntry.block_crcs.size());
+        BlobPut(blob, symbolEntry.block_crcs.data(), symbolEntry.block_crcs.size() * sizeof(uint32_t));
+
+        BlobPutU32(blob, symbolEntry.relocs->size());
+
+        for(auto& i : *symbolEntry.relocs)
+        {
+            BlobPutU32(blob, i.first.relocType);
+            BlobPutString(blob, strings.Get(i.first.relocSymbolName));
+            BlobPutU32(blob, i.second.size());
+            BlobPut(blob, i.second.data(), i.second.size() * sizeof(uint16_t));
+        }
+    }
+}
+
+bool CN64Sig::DeserializeSymbols(obj_processing_context_t *objProcessingCtx, uint32_t blockSize, const std::string& blob)
+{
+    size_t pos = 0;
+    uint32_t haveBlockSize, numUnhandledRelocs, numSymbols;
+
+    if(!BlobGetU32(blob, pos, &haveBlockSize) ||
+       !BlobGetU32(blob, pos, &numUnhandledRelocs) ||
+       !BlobGetU32(blob, pos, &numSymbols) ||
+       !BlobHasRoom(blob, pos, numSymbols, N64SIG_MIN_CACHED_SYMBOL_SIZE) ||
+       haveBlockSize != blockSize)
+    {
+        return false;
+    }
+
+    CStringPool& strings = objProcessingCtx->mt_this->m_Strings;
+    std::vector<symbol_entry_t> symbols(numSymbols);
+    std::string name;
+    bool bValid = true;
+
+    for(auto& symbolEntry : symbols)
+    {
+        uint32_t isData, lowEntropy, numPrefixWords, numBlocks, numRelocKeys;
+
+        symbolEntry.relocs = new reloc_map_t;
+        symbolEntry.block_size = blockSize;
+        symbolEntry.library = 0;
+        symbolEntry.crc_a_shared = 0;
+        symbolEntry.prefix_shared = 0;
+
+        if(!BlobGetString(blob, pos, name) ||
+           !BlobGetU32(blob, pos, &symbolEntry.size) ||
+           !BlobGetU32(blob, pos, &symbolEntry.crc_a) ||
+           !BlobGetU32(blob, pos, &symbolEntry.crc_b) ||
+           !BlobGetU32(blob, pos, &isData) ||
+           !BlobGetU32(blob, pos, &lowEntropy) ||
+           !BlobGetU32(blob, pos, &numPrefixWords) || numPrefixWords > N64SIG_MAX_PREFIX_WORDS)
+        {
+            bValid = false;
+            break;
+        }
+
+        symbolEntry.name = strings.Intern(name.c_str());
+        symbolEntry.is_data = (isData != 0);
+        symbolEntry.low_entropy = (lowEntropy != 0);
+        symbolEntry.prefix_words.resize(numPrefixWords);
+
+        if(!BlobGet(blob, pos, symbolEntry.prefix_words.data(), numPrefixWords * sizeof(uint32_t)) ||
+           !BlobGetU32(blob, pos, &numBlocks) || numBlocks > symbolEntry.size ||
+           !BlobHasRoom(blob, pos, numBlocks, sizeof(uint32_t)))
+        {
+            bValid = false;
+            break;
+        }
+
+        symbolEntry.block_crcs.resize(numBlocks);
+
+        if(!BlobGet(blob, pos, symbolEntry.block_crcs.data(), numBlocks * sizeof(uint32_t)) ||
+           !BlobGetU32(blob, pos, &numRelocKeys))
+        {
+            bValid = false;
+            break;
+        }
+
+        for(uint32_t nKey = 0; nKey < numRelocKeys && bValid; nKey++)
+        {
+            reloc_entry_t relocEntry;
+            uint32_t relocType, numOffsets;
+            memset(&relocEntry, 0, sizeof(relocEntry));
+
+            if(!BlobGetU32(blob, pos, &relocType) ||
+               !BlobGetString(blob, pos, name) ||
+               !BlobGetU32(blob, pos, &numOffsets) || numOffsets > symbolEntry.size ||
+               !BlobHasRoom(blob, pos, numOffsets, sizeof(uint16_t)))
+            {
+                bValid = false;
+                break;
+            }
+
+            relocEntry.relocType = relocType;
+            relocEntry.relocSymbolName = strings.Intern(name.c_str());
+            std::vector<uint16_t>& offsets = (*symbolEntry.relocs)[relocEntry];
+            offsets.resize(numOffsets);
+            bValid = BlobGet(blob, pos, offsets.data(), numOffsets * sizeof(uint16_t));
+        }
+
+        if(!bValid)
+        {
+            break;
+        }
+    }
+
+    if(!bValid || pos != blob.size())
+    {
+        for(auto& symbolEntry : symbols)
+        {
+            delete symbolEntry.relocs;
+        }
+        return false;
+    }
+
+    objProcessingCtx->numUnhandledRelocs = numUnhandledRelocs;
+    objProcessingCtx->symbols.swap(symbols);
+    return true;
+}
+
+bool CN64Sig::LoadCache(const char *path)
+{
+    // a missing or unreadable cache just means everything is processed
+    FILE *fp = fopen(path, "rb");
+
+    if(fp == NULL)
+    {
+        return false;
+    }
+
+    char signature[sizeof(N64SIG_CACHE_SIG) - 1];
+
+    if(fread(signature, 1, sizeof(signature), fp) != sizeof(signature) ||
+       memcmp(signature, N64SIG_CACHE_SIG, sizeof(signature)) != 0)
+    {
+        fclose(fp);
+        return false;
+    }
+
+    long dataStart = ftell(fp);
+    fseek(fp, 0, SEEK_END);
+    long fileSize = ftell(fp);
+    fseek(fp, dataStart, SEEK_SET);
+
+    uint64_t hash;
+    uint32_t blobSize;
+    uint32_t blobCrc;
+
+    while(fread(&hash, sizeof(hash), 1, fp) == 1 &&
+          fread(&blobSize, sizeof(blobSize), 1, fp) == 1 &&
+          fread(&blobCrc, sizeof(blobCrc), 1, fp) == 1)
+    {
+        // a damaged size must not be allocated
+        if(blobSize > fileSize - ftell(fp))
+        {
+            break;
+        }
+
+        std::string& blob = m_Cache[hash];
+        blob.resize(blobSize);
+
+        if(fread(&blob[0], 1, blobSize, fp) != blobSize)
+        {
+            m_Cache.erase(hash);
+            break;
+        }
+
+        if(crc32((const uint8_t *)blob.data(), blobSize) != blobCrc)
+        {
+            // damaged entries are processed again
+            m_Cache.erase(hash);
+        }
+    }
+
+    fclose(fp);
+    return true;
+}
+
+bool CN64Sig::SaveCache(const char *path)
+{
+    FILE *fp = fopen(path, "wb");
+
+    if(fp == NULL)
+    {
+        return false;
+    }
+
+    fwrite(N64SIG_CACHE_SIG, 1, sizeof(N64SIG_CACHE_SIG) - 1, fp);
+
+    for(auto& i : m_Cache)
+    {
+        uint32_t blobSize = i.second.size();
+        uint32_t blobCrc = crc32((const uint8_t *)i.second.data(), blobSize);
+        fwrite(&i.first, sizeof(i.first), 1, fp);
+        fwrite(&blobSize, sizeof(blobSize), 1, fp);
+        fwrite(&blobCrc, sizeof(blobCrc), 1, fp);
+        fwrite(i.second.data(), 1, blobSize, fp);
+    }
+
+    return (fclose(fp) == 0);
+}
+
+void CN64Sig::ProcessObject(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+
+    if(fp == NULL)
+    {
+        return;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    size_t size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    obj_processing_context_t *objProcessingCtx = new obj_processing_context_t;
+    objProcessingCtx->mt_this = this;
+    objProcessingCtx->linkedElf = NULL;
+    PathGetFileName(path, objProcessingCtx->objectName, sizeof(objProcessingCtx->objectName));
+    PathGetFileName(path, objProcessingCtx->libraryName, sizeof(objProcessingCtx->libraryName));
+    objProcessingCtx->data = new uint8_t[size];
+    objProcessingCtx->size = fread(objProcessingCtx->data, 1, size, fp);
+    objProcessingCtx->numUnhandledRelocs = 0;
+    objProcessingCtx->hash = HashObject(objProcessingCtx->objectName, objProcessingCtx->data, objProcessingCtx->size);
+    fclose(fp);
+
+    m_Objects.push_back(objProcessingCtx);
+}
+
+void CN64Sig::ProcessLinkedElf(const char *path)
+{
+    // linked ELFs have symbols but no relocations, the relocated fields of
+    // each function are found from instruction patterns instead
+
+    linked_elf_t *linkedElf = new linked_elf_t;
+    CElfContext& elf = linkedElf->elf;
+
+    if(!elf.Load(path) || elf.Size() < sizeof(CElfHeader) ||
+       memcmp(elf.Header()->e_ident, "\x7F" "ELF", 4) != 0 || elf.Type() != ET_EXEC)
+    {
+        printf("# error: %s is not a linked ELF\n", path);
+        delete linkedElf;
+        return;
+    }
+
+    PathGetFileName(path, linkedElf->name, sizeof(linkedElf->name));
+    linkedElf->gp = 0;
+    linkedElf->bHaveGp = false;
+
+    for(int nSection = 0; nSection < elf.NumSections(); nSection++)
+    {
+        CElfSection *section = elf.Section(nSection);
+
+        if(!(section->Flags() & SHF_ALLOC) || section->Size() == 0)
+        {
+            continue;
+        }
+
+        linked_section_t linkedSection;
+        linkedSection.name = section->Name(&elf);
+        linkedSection.address = section->Address();
+        linkedSection.size = section->Size();
+        linkedSection.data = NULL;
+        linkedSection.bCode = (section->Flags() & SHF_EXECINSTR) != 0;
+
+        if(section->Type() != SHT_NOBITS && (size_t)section->Offset() + section->Size() <= elf.Size())
+        {
+            linkedSection.data = (uint8_t *)section->Data(&elf);
+        }
+
+        linkedElf->sections.push_back(linkedSection);
+    }
+
+    CElfSection *symTabSection = elf.Section(".symtab");
+    CElfSection *strTabSection = elf.Section(".strtab");
+
+    if(symTabSection == NULL || strTabSection == NULL)
+    {
+        printf("# error: %s has no symbol table\n", path);
+        delete linkedElf;
+        return;
+    }
+
+    CElfSymbol *symbols = (CElfSymbol *)symTabSection->Data(&elf);
+    size_t numSymbols = symTabSection->Size() / sizeof(CElfSymbol);
+    linkedElf->strTab = strTabSection->Data(&elf);
+
+    // global names take precedence over local names at the same address
+    for(int pass = 0; pass < 2; pass++)
+    {
+        for(size_t nSymbol = 0; nSymbol < numSymbols; nSymbol++)
+        {
+            CElfSymbol *symbol = &symbols[nSymbol];
+            const char *symbolName = &linkedElf->strTab[symbol->NameOffset()];
+            bool bGlobal = (symbol->Binding() != STB_LOCAL);
+
+            if(symbolName[0] == '\0' || symbolName[0] == '.' || symbolName[0] == '$' ||
+               symbol->Type() == STT_SECTION || symbol->Type() == STT_FILE ||
+               symbol->SectionIndex() == SHN_UNDEF || bGlobal != (pass == 0))
+            {
+                continue;
+            }
+
+            if(strcmp(symbolName, "_gp") == 0)
+            {
+                linkedElf->gp = symbol->Value();
+                linkedElf->bHaveGp = true;
+                continue;
+            }
+
+            linkedElf->symbolNames.insert({ symbol->Value(), symbolName });
+        }
+    }
+
+    for(size_t nSymbol = 0; nSymbol < numSymbols; nSymbol++)
+    {
+        CElfSymbol *symbol = &symbols[nSymbol];
+        uint32_t address = symbol->Value();
+        uint32_t size = symbol->Size();
+
+        if(symbol->Type() != STT_FUNC || size == 0 || size % 4 != 0 || address % 4 != 0)
+        {
+            continue;
+        }
+
+        const linked_section_t *section = FindLinkedSection(linkedElf, address);
+
+        if(section == NULL || !section->bCode || section->data == NULL ||
+           address - section->address + size > section->size)
+        {
+            continue;
+        }
+
+        linkedElf->functions.push_back(symbol);
+    }
+
+    if(m_bVerbose)
+    {
+        printf("# %s: %d functions\n", linkedElf->name, (int)linkedElf->functions.size());
+    }
+
+    // functions are handed to the workers in fixed-size batches, each cached separately
+    uint64_t elfHash = HashObject(linkedElf->name, (uint8_t *)elf.Header(), elf.Size());
+
+    for(size_t first = 0; first < linkedElf->functions.size(); first += N64SIG_LINKED_BATCH_SIZE)
+    {
+        obj_processing_context_t *objProcessingCtx = new obj_processing_context_t;
+        objProcessingCtx->mt_this = this;
+        objProcessingCtx->linkedElf = linkedElf;
+        objProcessingCtx->firstFunction = first;
+        objProcessingCtx->numFunctions = min(linkedElf->functions.size() - first, (size_t)N64SIG_LINKED_BATCH_SIZE);
+        strcpy(objProcessingCtx->objectName, linkedElf->name);
+        strcpy(objProcessingCtx->libraryName, linkedElf->name);
+        objProcessingCtx->data = NULL;
+        objProcessingCtx->size = 0;
+        objProcessingCtx->numUnhandledRelocs = 0;
+        objProcessingCtx->hash = (elfHash ^ first) * 0x100000001B3ULL;
+
+        m_Objects.push_back(objProcessingCtx);
+    }
+
+    m_LinkedElfs.push_back(linkedElf);
+}
+
+void CN64Sig::ProcessLinkedFunctions(obj_processing_context_t *objProcessingCtx)
+{
+    linked_elf_t *linkedElf = objProcessingCtx->linkedElf;
+    size_t end = objProcessingCtx->firstFunction + objProcessingCtx->numFunctions;
+
+    for(size_t nFunction = objProcessingCtx->firstFunction; nFunction < end; nFunction++)
+    {
+        ProcessLinkedFunction(objProcessingCtx, linkedElf->functions[nFunction]);
+    }
+}
+
+void CN64Sig::ProcessLinkedFunction(obj_processing_context_t *objProcessingCtx, CElfSymbol *symbol)
+{
+    linked_elf_t *linkedElf = objProcessingCtx->linkedElf;
+    uint32_t address = symbol->Value();
+    uint32_t size = symbol->Size();
+
+    // bounds were checked in ProcessLinkedElf
+    const linked_section_t *section = FindLinkedSection(linkedElf, address);
+    std::vector<uint8_t> code(&section->data[address - section->address], &section->data[address - section->address + size]);
+
+    symbol_entry_t symbolEntry;
+    symbolEntry.name = m_Strings.Intern(&linkedElf->strTab[symbol->NameOffset()]);
+    symbolEntry.size = size;
+    symbolEntry.library = 0;
+    symbolEntry.crc_a_shared = 0;
+    symbolEntry.prefix_shared = 0;
+    symbolEntry.relocs = new reloc_map_t;
+    symbolEntry.is_data = false;
+
+    // most recent lui of each register that has not been overwritten since
+    struct
+    {
+        bool     bValid;
+        uint32_t offset;
+        uint16_t imm;
+        uint32_t name; // 0 until a low half is paired with it
+    } hi[32];
+
+    memset(hi, 0, sizeof(hi));
+
+    for(uint32_t offset = 0; offset < size; offset += 4)
+    {
+        uint32_t opcode = bswap32(*(uint32_t *)&code[offset]);
+        uint32_t op = opcode >> 26;
+        int rs = (opcode >> 21) & 0x1F;
+        int rt = (opcode >> 16) & 0x1F;
+        uint16_t imm = opcode & 0xFFFF;
+        uint32_t strippedOpcode = opcode;
+        char relocName[512];
+        reloc_entry_t relocEntry;
+
+        switch(op)
+        {
+        case 0x02: // j
+        case 0x03: // jal
+            GetLinkedSymbolName(linkedElf, ((address + offset) & 0xF0000000) | ((opcode & 0x03FFFFFF) << 2),
+                relocName, sizeof(relocName));
+            relocEntry.relocType = R_MIPS_26;
+            relocEntry.relocSymbolName = m_Strings.Intern(relocName);
+            (*symbolEntry.relocs)[relocEntry].push_back(offset);
+            strippedOpcode &= 0xFC000000;
+            break;
+        case 0x09: // addiu
+        case 0x20: case 0x21: case 0x22: case 0x23: case 0x24: case 0x25: case 0x26: case 0x27: case 0x37: // loads
+        case 0x28: case 0x29: case 0x2A: case 0x2B: case 0x2E: case 0x3F: // stores
+        case 0x31: case 0x35: case 0x39: case 0x3D: // lwc1, ldc1, swc1, sdc1
+            if(rs == 28 && linkedElf->bHaveGp)
+            {
+                GetLinkedSymbolName(linkedElf, linkedElf->gp + (int16_t)imm, relocName, sizeof(relocName));
+                relocEntry.relocType = R_MIPS_GPREL16;
+                relocEntry.relocSymbolName = m_Strings.Intern(relocName);
+                (*symbolEntry.relocs)[relocEntry].push_back(offset);
+                strippedOpcode &= 0xFFFF0000;
+            }
+            else if(hi[rs].bValid && rs != 0)
+            {
+                uint32_t target = (hi[rs].imm << 16) + (int16_t)imm;
+
+                if(FindLinkedSection(linkedElf, target) == NULL)
+                {
+                    // a constant rather than an address
+                    break;
+                }
+
+                if(hi[rs].name == 0)
+                {
+                    // later low halves that use the same lui keep its name so that
+                    // every lo16 has a hi16 to pair with
+                    GetLinkedSymbolName(linkedElf, target, relocName, sizeof(relocName));
+                    hi[rs].name = m_Strings.Intern(relocName);
+
+                    relocEntry.relocType = R_MIPS_HI16;
+                    relocEntry.relocSymbolName = hi[rs].name;
+                    (*symbolEntry.relocs)[relocEntry].push_back(hi[rs].offset);
+
+                    uint32_t hiOpcode = bswap32(*(uint32_t *)&code[hi[rs].offset]) & 0xFFFF0000;
+                    *(uint32_t *)&code[hi[rs].offset] = bswap32(hiOpcode);
+                }
+
+                relocEntry.relocType = R_MIPS_LO16;
+                relocEntry.relocSymbolName = hi[rs].name;
+                (*symbolEntry.relocs)[relocEntry].push_back(offset);
+                strippedOpcode &= 0xFFFF0000;
+            }
+            break;
+        }
+
+        int writtenRegister = GetWrittenRegister(opcode);
+
+        if(writtenRegister > 0)
+        {
+            hi[writtenRegister].bValid = false;
+        }
+
+        if(op == 0x0F && rt != 0) // lui
+        {
+            hi[rt].bValid = true;
+            hi[rt].offset = offset;
+            hi[rt].imm = imm;
+            hi[rt].name = 0;
+        }
+
+        *(uint32_t *)&code[offset] = bswap32(strippedOpcode);
+    }
+
+    // offsets are collected in order, a hi16 may be added after the lo16s of earlier pairs
+    for(auto& i : *symbolEntry.relocs)
+    {
+        std::sort(i.second.begin(), i.second.end());
+    }
+
+    AddObjectSymbol(objProcessingCtx, symbolEntry, code.data());
+}
+
+const CN64Sig::linked_section_t *CN64Sig::FindLinkedSection(const linked_elf_t *linkedElf, uint32_t address)
+{
+    for(auto& section : linkedElf->sections)
+    {
+        if(address >= section.address && address - section.address < section.size)
+        {
+            return &section;
+        }
+    }
+
+    return NULL;
+}
+
+void CN64Sig::GetLinkedSymbolName(const linked_elf_t *linkedElf, uint32_t address, char *name, size_t maxLength)
+{
+    auto symbolName = linkedElf->symbolNames.find(address);
+
+    if(symbolName != linkedElf->symbolNames.end())
+    {
+        snprintf(name, maxLength, "%s", symbolName->second);
+        return;
+    }
+
+    // unnamed, use the same form as section-relative relocations in objects
+    const linked_section_t *section = FindLinkedSection(linkedElf, address);
+
+    if(section != NULL)
+    {
+        const char *sectionName = (section->name[0] == '.') ? &section->name[1] : section->name;
+        snprintf(name, maxLength, "%s_%s_%04X", linkedElf->name, sectionName, address - section->address);
+        return;
+    }
+
+    snprintf(name, maxLength, "%s_%08X", linkedElf->name, address);
+}
+
+int CN64Sig::GetWrittenRegister(uint32_t opcode)
+{
+    // general purpose register written by an instruction, -1 if none
+    uint32_t op = opcode >> 26;
+    int rs = (opcode >> 21) & 0x1F;
+    int rt = (opcode >> 16) & 0x1F;
+    int rd = (opcode >> 11) & 0x1F;
+
+    switch(op)
+    {
+    case 0x00: // special
+        switch(opcode & 0x3F)
+        {
+        case 0x08: // jr
+        case 0x0C: // syscall
+        case 0x0D: // break
+        case 0x0F: // sync
+        case 0x11: // mthi
+        case 0x13: // mtlo
+            return -1;
+        }
+        if((opcode & 0x3F) >= 0x18 && (opcode & 0x3F) <= 0x1F)
+        {
+            return -1; // mult, div
+        }
+        return rd;
+    case 0x03: // jal
+        return 31;
+    case 0x08: case 0x09: case 0x0A: case 0x0B: case 0x0C: case 0x0D: case 0x0E: case 0x0F: // immediate alu, lui
+    case 0x18: case 0x19: // daddi, daddiu
+    case 0x1A: case 0x1B: // ldl, ldr
+    case 0x20: case 0x21: case 0x22: case 0x23: case 0x24: case 0x25: case 0x26: case 0x27: case 0x37: // loads
+        return rt;
+    case 0x10: case 0x11: case 0x12: // coprocessor moves to gprs
+        if(rs == 0x00 || rs == 0x01 || rs == 0x02)
+        {
+            return rt;
+        }
+        return -1;
+    }
+
+    return -1;
+}
+
+void CN64Sig::ProcessFile(const char *path)
+{
     if(PathIsStaticLibrary(path))
     {
         ProcessLibrary(path);
@@ -507,6 +2006,17 @@ void CN64Sig::SetVerbose(bool bVerbose)
     m_bVerbose = bVerbose;
 }
 
+bool CN64Sig::SetBlockSize(uint32_t blockSize)
+{
+    if(blockSize % 4 != 0)
+    {
+        return false;
+    }
+
+    m_BlockSize = blockSize;
+    return true;
+}
+
 bool CN64Sig::SetOutputFormat(const char *format)
 {
     if(strcmp(format, "json") == 0)
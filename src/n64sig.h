@@ -8,15 +8,34 @@
 */
 
 #include <cstdint>
+#include <cstdio>
 #include <string>
 #include <map>
 #include <vector>
 
 #include "elfutil.h"
+#include "threadpool.h"
+#include "bufferedwriter.h"
+#include "stringpool.h"
 
 #ifndef N64SIG_H
 #define N64SIG_H
 
+// maximum number of leading words kept to tell a signature apart from the others
+#define N64SIG_MAX_PREFIX_WORDS 16
+
+// bytes of a cached symbol with no name, prefix words, blocks or relocations
+#define N64SIG_MIN_CACHED_SYMBOL_SIZE 36
+
+// bodies with fewer distinct words than this are flagged as low entropy
+#define N64SIG_LOW_ENTROPY_WORDS 4
+
+// number of functions of a linked ELF handed to each worker, see -e
+#define N64SIG_LINKED_BATCH_SIZE 64
+
+// object cache file signature, see -c
+#define N64SIG_CACHE_SIG "n64sigc4"
+
 typedef enum
 {
     N64SIG_FMT_DEFAULT,
@@ -27,48 +46,197 @@ class CN64Sig
 {
     typedef struct {
         uint8_t relocType;
-        char relocSymbolName[128];
+        uint32_t relocSymbolName; // id in m_Strings
         //uint32_t param;
     } reloc_entry_t;
 
+    // orders by id; output is sorted by name separately, see GetSortedRelocs()
     struct reloc_entry_cmp_t
     {
         bool operator()(const reloc_entry_t& a, const reloc_entry_t& b) const
         {
-            int t = strcmp(a.relocSymbolName, b.relocSymbolName);
-            if(t == 0)
+            if(a.relocSymbolName == b.relocSymbolName)
             {
                 return a.relocType < b.relocType;
             }
-            return t < 0;
+            return a.relocSymbolName < b.relocSymbolName;
         }
     };
 
     typedef std::map<reloc_entry_t, std::vector<uint16_t>, reloc_entry_cmp_t> reloc_map_t;
+    typedef std::vector<const reloc_map_t::value_type *> sorted_relocs_t;
+    typedef std::map<uint16_t, uint32_t> reloc_names_t; // relocation offset -> name id in m_Strings
 
     typedef struct
     {
-        char         name[64];
+        uint32_t     name; // id in m_Strings
         uint32_t     size;
         uint32_t     crc_a;
         uint32_t     crc_b;
         reloc_map_t *relocs;
+        std::vector<uint32_t> aliases; // ids in m_Strings
+        std::vector<reloc_names_t> alias_relocs; // for each alias, relocations that target another name
+        uint32_t     block_size; // 0 if block crcs are not used
+        std::vector<uint32_t> block_crcs;
+        std::vector<uint32_t> prefix_words; // leading words with relocations stripped
+        bool         is_data; // data object rather than a function
+        uint32_t     library; // id in m_Strings, 0 if not known
+        uint32_t     crc_a_shared;  // number of other symbols with the same crc_a
+        uint32_t     prefix_shared; // number of other symbols that start with prefix_words
+        bool         low_entropy;   // body too small or repetitive to identify on its own
     } symbol_entry_t;
 
-    std::map<uint32_t, symbol_entry_t> m_SymbolMap;
+    // identifies a unique symbol body; crc_b alone may collide
+    typedef struct
+    {
+        uint32_t size;
+        uint32_t crc_a;
+        uint32_t crc_b;
+        bool     is_data;
+        std::vector<uint32_t> relocLayout; // (offset << 8) | relocType, sorted
+    } symbol_key_t;
+
+    struct symbol_key_cmp_t
+    {
+        bool operator()(const symbol_key_t& a, const symbol_key_t& b) const
+        {
+            if(a.size != b.size) return a.size < b.size;
+            if(a.crc_a != b.crc_a) return a.crc_a < b.crc_a;
+            if(a.crc_b != b.crc_b) return a.crc_b < b.crc_b;
+            if(a.is_data != b.is_data) return b.is_data;
+            return a.relocLayout < b.relocLayout;
+        }
+    };
+
+    // allocated section of a linked ELF
+    typedef struct
+    {
+        const char *name;
+        uint32_t    address;
+        uint32_t    size;
+        uint8_t    *data;  // NULL for .bss-like sections
+        bool        bCode;
+    } linked_section_t;
+
+    // fully linked ELF without relocations, shared by the workers that process its functions
+    typedef struct
+    {
+        CElfContext elf;
+        char        name[256];
+        std::vector<linked_section_t> sections;
+        std::vector<CElfSymbol *> functions; // sized functions in code sections
+        std::map<uint32_t, const char *> symbolNames; // address -> name
+        const char *strTab;
+        uint32_t    gp;
+        bool        bHaveGp;
+    } linked_elf_t;
+
+    // one object file or library member, processed on a worker thread
+    typedef struct
+    {
+        CN64Sig*    mt_this;
+        linked_elf_t *linkedElf; // NULL unless this is a batch of linked ELF functions
+        size_t      firstFunction;
+        size_t      numFunctions;
+        char        objectName[256];
+        char        libraryName[256]; // archive the object came from, or the object itself
+        uint8_t*    data;
+        size_t      size;
+        uint64_t    hash;      // cache key, covers the name and the data
+        std::vector<symbol_entry_t> symbols;
+        size_t      numUnhandledRelocs;
+    } obj_processing_context_t;
+
+    // relocations of one section, indexed by offset
+    typedef struct
+    {
+        CElfRelocation *relocs;
+        std::vector<uint32_t> byOffset; // indices into relocs, sorted by offset
+        std::vector<uint32_t> offsets;  // offset of each relocation in byOffset
+    } reloc_table_t;
+
+    // section data of the object being processed, looked up once per object
+    typedef struct
+    {
+        int             sectionIndex; // -1 if the object has no such section
+        uint8_t        *data;
+        reloc_table_t   relocs;
+    } section_tables_t;
+
+    typedef struct
+    {
+        section_tables_t text;
+        section_tables_t data;
+        section_tables_t rodata;
+        CElfSymbol     *symbols;     // .symtab
+        size_t          numSymbols;
+        const char     *strTab;
+    } object_tables_t;
+
+    typedef struct
+    {
+        n64sig_output_fmt_t format;
+        const char *path; // NULL for stdout
+        FILE *file;
+        CBufferedWriter *writer;
+        size_t numSymbolsWritten;
+    } output_target_t;
+
+    std::map<symbol_key_t, symbol_entry_t, symbol_key_cmp_t> m_SymbolMap;
+    std::vector<obj_processing_context_t *> m_Objects; // in input order
+    std::vector<linked_elf_t *> m_LinkedElfs;
+    std::vector<output_target_t> m_Outputs;
+    std::map<uint64_t, std::string> m_Cache; // object hash -> serialized symbols
+    const char *m_CachePath;
+    CThreadPool m_ThreadPool;
+    CStringPool m_Strings; // symbol and relocation names
     std::vector<const char *> m_LibPaths;
+    std::vector<const char *> m_SigPaths;
+    std::vector<const char *> m_ElfPaths;
 
     bool   m_bVerbose;
     n64sig_output_fmt_t m_OutputFormat;
+    uint32_t m_BlockSize;
     size_t m_NumProcessedSymbols;
+    size_t m_NumCachedObjects;
     
     static const char *GetRelTypeName(uint8_t relType);
     static void FormatAnonymousSymbol(char *symbolName);
-    void StripAndGetRelocsInSymbol(const char *objectName, reloc_map_t& relocs, CElfSymbol *symbol, CElfContext& elf);
+    static void TrimPrefixes(std::vector<symbol_entry_t>& symbols);
+    static void ComputeStats(std::vector<symbol_entry_t>& symbols);
+    static bool IsLowEntropy(const uint8_t *symbolData, uint32_t symbolSize);
+    static void GetSymbolKey(const symbol_entry_t& symbolEntry, symbol_key_t& key);
+    static void GetRelocNames(const symbol_entry_t& symbolEntry, reloc_names_t& names);
+    static void LoadSectionTables(CElfContext& elf, const char *name, section_tables_t& section);
+    static void GetRelocsInRange(const reloc_table_t& table, uint32_t offset, uint32_t size, std::vector<uint32_t>& relocs);
+    static void StripAndGetRelocsInSymbol(obj_processing_context_t *objProcessingCtx, reloc_map_t& relocs, CElfSymbol *symbol, CElfContext& elf, object_tables_t& tables);
+    static void StripAndGetRelocsInData(obj_processing_context_t *objProcessingCtx, reloc_map_t& relocs, CElfSymbol *symbol, CElfContext& elf, object_tables_t& tables, section_tables_t& section);
+    void AddObjectSymbol(obj_processing_context_t *objProcessingCtx, symbol_entry_t& symbolEntry, const uint8_t *symbolData);
+    void AddSymbol(symbol_entry_t& symbolEntry);
     void ProcessLibrary(const char *path);
-    void ProcessObject(CElfContext& elf, const char *objectName);
+    void ProcessObject(obj_processing_context_t *objProcessingCtx);
+    static void *ProcessObjectProc(void *_objProcessingCtx);
     void ProcessObject(const char *path);
+    void ProcessObjects();
+    void ProcessLinkedElf(const char *path);
+    void ProcessLinkedFunctions(obj_processing_context_t *objProcessingCtx);
+    void ProcessLinkedFunction(obj_processing_context_t *objProcessingCtx, CElfSymbol *symbol);
+    static const linked_section_t *FindLinkedSection(const linked_elf_t *linkedElf, uint32_t address);
+    static void GetLinkedSymbolName(const linked_elf_t *linkedElf, uint32_t address, char *name, size_t maxLength);
+    static int GetWrittenRegister(uint32_t opcode);
+    static uint64_t HashObject(const char *objectName, const uint8_t *data, size_t size);
+    static void SerializeSymbols(obj_processing_context_t *objProcessingCtx, uint32_t blockSize, std::string& blob);
+    static bool DeserializeSymbols(obj_processing_context_t *objProcessingCtx, uint32_t blockSize, const std::string& blob);
+    bool LoadCache(const char *path);
+    bool SaveCache(const char *path);
+    void WriteHeader(output_target_t& output);
+    void WriteSymbol(output_target_t& output, const symbol_entry_t& symbolEntry);
+    void WriteFooter(output_target_t& output);
+    void GetSortedRelocs(const symbol_entry_t& symbolEntry, sorted_relocs_t& sorted);
+    void WriteDefaultSymbol(CBufferedWriter *out, const symbol_entry_t& symbolEntry);
+    bool WriteJsonSymbol(CBufferedWriter *out, const symbol_entry_t& symbolEntry, bool bFirstSymbol);
     void ProcessFile(const char *path);
+    void ProcessSignatureFile(const char *path);
     void ScanRecursive(const char* path);
 
 public:
@@ -76,8 +244,13 @@ public:
     ~CN64Sig();
 
     void AddLibPath(const char *path);
+    void AddSigPath(const char *path);
+    void AddElfPath(const char *path);
     void SetVerbose(bool bVerbose);
     bool SetOutputFormat(const char *format);
+    void AddOutput(const char *path);
+    void SetCachePath(const char *path);
+    bool SetBlockSize(uint32_t blockSize);
     bool Run();
 };
 
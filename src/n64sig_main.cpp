@@ -9,6 +9,7 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 
 #include "n64sig.h"
 
@@ -18,21 +19,40 @@ int main(int argc, const char *argv[])
     {
         printf (
             "n64sig - signature file generator for n64sym (https://github.com/shygoo/n64sym)\n\n"
-            "  Usage: n64sig [options]\n\n"
+            "  Usage: n64sig [options]\n"
+            "         n64sig merge <sig path(s)> [options]\n\n"
             "  Options:\n"
             "    -l <lib/obj path>     add a library/object path\n"
+            "    -e <elf path>         add a linked ELF, relocations are inferred from its code\n"
             "    -f <format>           set the output format (json, default)\n"
+            "    -o <output path>      write the output in the current format to a file; may be repeated\n"
+            "    -c <cache path>       reuse signatures of unchanged objects from a cache file\n"
+            "    -b <block size>       add crcs of each <block size> bytes of symbol data\n"
         );
 
         return EXIT_FAILURE;
     }
 
     CN64Sig n64sig;
+    bool bMerge = false;
+    int argi = 1;
 
-    for(int argi = 1; argi < argc; argi++)
+    if(strcmp(argv[1], "merge") == 0)
+    {
+        bMerge = true;
+        argi++;
+    }
+
+    for(; argi < argc; argi++)
     {
         //printf("[%s]\n", argv[argi]);
 
+        if(bMerge && argv[argi][0] != '-')
+        {
+            n64sig.AddSigPath(argv[argi]);
+            continue;
+        }
+
         if(argv[argi][0] != '-')
         {
             printf("Error: Unexpected '%s' in command line\n", argv[argi]);
@@ -55,6 +75,15 @@ int main(int argc, const char *argv[])
             n64sig.AddLibPath(argv[argi+1]);
             argi++;
             break;
+        case 'e':
+            if(argi+1 >= argc)
+            {
+                printf("Error: No path specified for '-e'\n");
+                return EXIT_FAILURE;
+            }
+            n64sig.AddElfPath(argv[argi+1]);
+            argi++;
+            break;
         case 'f':
             if(argi+1 >= argc)
             {
@@ -68,13 +97,47 @@ int main(int argc, const char *argv[])
             }
             argi++;
             break;
+        case 'o':
+            if(argi+1 >= argc)
+            {
+                printf("Error: No path specified for '-o'\n");
+                return EXIT_FAILURE;
+            }
+            n64sig.AddOutput(argv[argi+1]);
+            argi++;
+            break;
+        case 'c':
+            if(argi+1 >= argc)
+            {
+                printf("Error: No path specified for '-c'\n");
+                return EXIT_FAILURE;
+            }
+            n64sig.SetCachePath(argv[argi+1]);
+            argi++;
+            break;
+        case 'b':
+            if(argi+1 >= argc)
+            {
+                printf("Error: No block size specified for '-b'\n");
+                return EXIT_FAILURE;
+            }
+            if(!n64sig.SetBlockSize(strtoul(argv[argi+1], NULL, 0)))
+            {
+                printf("Error: Block size must be a multiple of 4\n");
+                return EXIT_FAILURE;
+            }
+            argi++;
+            break;
         case 'v':
             n64sig.SetVerbose(true);
             break;
         }
     }
 
-    n64sig.Run();
+    if(!n64sig.Run())
+    {
+        return EXIT_FAILURE;
+    }
 
     return EXIT_SUCCESS;
 }
@@ -8,24 +8,28 @@
 */
 
 #include <fstream>
-#include <iostream>
 #include <cstdio>
 #include <set>
 #include <map>
-
-#include <miniz/miniz.h>
-#include <miniz/miniz.c>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
 
 #include "n64sym.h"
-#include "builtin_signatures.h"
 #include "signaturefile.h"
 #include "pathutil.h"
 #include "crc32.h"
 
+#include <miniz/miniz.h>
+
 #ifdef WIN32
 #include <windirent.h>
 #else
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 CN64Sym::n64sym_fmt_lut_t CN64Sym::FormatNames[] = {
@@ -37,46 +41,109 @@ CN64Sym::n64sym_fmt_lut_t CN64Sym::FormatNames[] = {
     { "splat",    N64SYM_FMT_SPLAT}
 };
 
+const char *CN64Sym::MatchKindNames[] = {
+    "complete",
+    "partial",
+    "data",
+    "relocation",
+    "alias",
+    "known"
+};
+
 CN64Sym::CN64Sym() :
     m_Binary(NULL),
     m_BinarySize(0),
+    m_bBinaryMapped(false),
+    m_LikelyFunctionsEnd(0),
     m_HeaderSize(0x80000000),
     m_bVerbose(false),
     m_bUseBuiltinSignatures(false),
     m_bThoroughScan(false),
     m_bOverrideHeaderSize(false),
-    m_Output(&std::cout),
+    m_bDumpResults(true),
+    m_bShowProgress(true),
+    m_StreamFile(NULL),
+    m_bOwnStreamFile(false),
+    m_CurrentSource(NULL),
     m_OutputFormat(N64SYM_FMT_DEFAULT),
     m_NumSymbolsToCheck(0),
-    m_NumSymbolsChecked(0)
+    m_NumSymbolsChecked(0),
+    m_NumCandidateTests(0),
+    m_Index(&m_OwnIndex),
+    m_bOwnIndexLoaded(false),
+    m_bUseSession(false),
+    m_SessionPath(NULL),
+    m_bHavePrevSession(false),
+    m_bIncremental(false),
+    m_ClaimOffset(0),
+    m_ClaimSize(0)
 {
-    char *builtinSigFileContents = new char[gBuiltinSignatureFile.uncSize];
+}
 
-    uLong uncSize = gBuiltinSignatureFile.uncSize;
-    uncompress((uint8_t *)builtinSigFileContents, &uncSize,
-        gBuiltinSignatureFile.data, gBuiltinSignatureFile.cmpSize);
+CN64Sym::~CN64Sym()
+{
+    UnloadBinary();
 
-    m_BuiltinSigs.LoadFromMemory(builtinSigFileContents);
+    if(m_bOwnStreamFile)
+    {
+        fclose(m_StreamFile);
+    }
 
-    delete[] builtinSigFileContents;
+    for(auto& output : m_Outputs)
+    {
+        if(output.bOwnFile)
+        {
+            fclose(output.file);
+        }
+    }
 }
 
-CN64Sym::~CN64Sym()
+void CN64Sym::UnloadBinary()
 {
-    if(m_Binary != NULL)
+    if(m_Binary == NULL)
+    {
+        return;
+    }
+
+#ifndef WIN32
+    if(m_bBinaryMapped)
+    {
+        munmap(m_Binary, m_BinarySize);
+    }
+    else
+#endif
     {
         delete[] m_Binary;
     }
+
+    m_Binary = NULL;
+    m_BinarySize = 0;
+    m_bBinaryMapped = false;
+    m_LikelyFunctionsEnd = 0;
+    m_LikelyFunctionOffsets.clear();
 }
 
 bool CN64Sym::LoadBinary(const char *binPath)
 {
-    if(m_Binary != NULL)
+    UnloadBinary();
+
+#ifndef WIN32
+    if(strcmp(binPath, "-") == 0)
     {
-        delete[] m_Binary;
-        m_BinarySize = 0;
+        return LoadBinary(STDIN_FILENO, binPath);
+    }
+
+    int fd = open(binPath, O_RDONLY);
+
+    if(fd < 0)
+    {
+        return false;
     }
 
+    bool bLoaded = LoadBinary(fd, binPath);
+    close(fd);
+    return bLoaded;
+#else
     std::ifstream file;
     file.open(binPath, std::ifstream::binary);
 
@@ -92,794 +159,2216 @@ bool CN64Sym::LoadBinary(const char *binPath)
     file.seekg(0, file.beg);
     file.read((char *)m_Binary, m_BinarySize);
 
-    if(PathIsN64Rom(binPath) && !m_bOverrideHeaderSize)
+    return ProcessBinary(binPath);
+#endif
+}
+
+#ifndef WIN32
+// binName is only used to tell ROM images apart from RAM dumps
+bool CN64Sym::LoadBinary(int fd, const char *binName)
+{
+    UnloadBinary();
+
+    struct stat st;
+
+    if(fstat(fd, &st) != 0)
+    {
+        return false;
+    }
+
+    if(S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        // map the file copy-on-write; pages are only copied if they need to be byte-swapped
+        void *mapping = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+        if(mapping != MAP_FAILED)
+        {
+            m_Binary = (uint8_t *)mapping;
+            m_BinarySize = st.st_size;
+            m_bBinaryMapped = true;
+            madvise(m_Binary, m_BinarySize, MADV_WILLNEED);
+            return ProcessBinary(binName);
+        }
+    }
+
+    // pipes, sockets and anything else that can't be mapped
+    size_t capacity = N64SYM_READ_BUFFER_SIZE;
+    m_Binary = new uint8_t[capacity];
+
+    bool bHeaderChecked = false;
+    bool bSearchWhileReading = false;
+    uint32_t swapMask = 0;
+    size_t completeSize = 0; // whole words that were normalized already
+
+    while(true)
     {
-        if(m_BinarySize < 0x101000)
+        if(m_BinarySize == capacity)
         {
+            uint8_t *buffer = new uint8_t[capacity * 2];
+            memcpy(buffer, m_Binary, m_BinarySize);
             delete[] m_Binary;
-            m_BinarySize = 0;
-            return false;
+            m_Binary = buffer;
+            capacity *= 2;
         }
 
-        uint32_t endianCheck = bswap32(*(uint32_t *)&m_Binary[0x00]);
+        ssize_t nBytesRead = read(fd, &m_Binary[m_BinarySize], capacity - m_BinarySize);
 
-        switch(endianCheck)
+        if(nBytesRead < 0)
         {
-        case 0x80371240:
-            break;
-        case 0x40123780:
-            for(size_t i = 0; i < m_BinarySize; i += sizeof(uint32_t))
+            if(errno == EINTR)
             {
-                *(uint32_t *)&m_Binary[i] = bswap32(*(uint32_t *)&m_Binary[i]);
+                continue;
             }
+
+            UnloadBinary();
+            return false;
+        }
+
+        if(nBytesRead == 0)
+        {
             break;
-        case 0x37804012:
-            for(size_t i = 0; i < m_BinarySize; i += sizeof(uint16_t))
+        }
+
+        m_BinarySize += nBytesRead;
+
+        if(!bHeaderChecked && m_BinarySize >= sizeof(uint32_t))
+        {
+            // archives are inflated as a whole once they're read, anything else is searched as it arrives
+            bHeaderChecked = true;
+            bSearchWhileReading = (m_Binary[0] != 0x1F && m_Binary[0] != 'P');
+
+            if(bSearchWhileReading && !m_bOverrideHeaderSize)
             {
-                *(uint16_t *)&m_Binary[i] = bswap16(*(uint16_t *)&m_Binary[i]);
+                DetectRomByteOrder(m_Binary, &swapMask);
             }
-            break;
         }
 
-        uint32_t entryPoint = bswap32(*(uint32_t *)&m_Binary[0x08]);
+        if(!bSearchWhileReading)
+        {
+            continue;
+        }
 
-        uint32_t bootCheck = crc32_begin();
-        crc32_read(&m_Binary[0x40], 0xFC0, &bootCheck);
-        crc32_end(&bootCheck);
+        size_t alignedSize = m_BinarySize & ~(size_t)(sizeof(uint32_t) - 1);
 
-        switch(bootCheck)
+        if(swapMask != 0)
         {
-        case 0x0B050EE0: // 6103
-            entryPoint -= 0x100000;
-            break;
-        case 0xACC8580A: // 6106
-            entryPoint -= 0x200000;
-            break;
+            swap_chunk_t chunk;
+            chunk.data = &m_Binary[completeSize];
+            chunk.size = alignedSize - completeSize;
+            chunk.bWordSwapped = (swapMask == 3);
+            NormalizeChunkProc(&chunk);
+        }
+
+        completeSize = alignedSize;
+
+        // a JR RA is only a candidate once the word after its delay slot is here too
+        if(completeSize >= 2 * sizeof(uint32_t))
+        {
+            FindLikelyFunctions(completeSize - 2 * sizeof(uint32_t));
         }
-        
-        m_HeaderSize = entryPoint - 0x1000;
     }
 
-    return true;
+    return ProcessBinary(binName);
 }
+#endif
 
-void CN64Sym::AddLibPath(const char* libPath)
+bool CN64Sym::ProcessBinary(const char *binName)
 {
-    m_LibPaths.push_back(libPath);
-}
+    // archives are recognized by their contents, the name may not say
+    if(m_BinarySize >= 4 &&
+       ((m_Binary[0] == 0x1F && m_Binary[1] == 0x8B && m_Binary[2] == 0x08) ||
+        (m_Binary[0] == 'P' && m_Binary[1] == 'K' && m_Binary[2] == 0x03 && m_Binary[3] == 0x04)))
+    {
+        return LoadArchive(binName);
+    }
 
-void CN64Sym::SetVerbose(bool bVerbose)
-{
-    m_bVerbose = bVerbose;
+    return ProcessRomHeader(binName);
 }
 
-void CN64Sym::UseBuiltinSignatures(bool bUseBuiltinSignatures)
+// replaces the archive in m_Binary with the file inside it
+bool CN64Sym::LoadArchive(const char *binName)
 {
-    m_bUseBuiltinSignatures = bUseBuiltinSignatures;
-}
+    uint8_t *archive = m_Binary;
+    size_t archiveSize = m_BinarySize;
+    bool bArchiveMapped = m_bBinaryMapped;
 
-void CN64Sym::SetThoroughScan(bool bThoroughScan)
-{
-    m_bThoroughScan = bThoroughScan;
-}
+    m_Binary = NULL;
+    m_BinarySize = 0;
+    m_bBinaryMapped = false;
 
-bool CN64Sym::SetOutputFormat(const char *fmtName)
-{
-    for(size_t i = 0; i < sizeof(FormatNames) / sizeof(FormatNames[0]); i++)
+    std::string contentsName;
+    bool bInflated;
+
+    if(archive[0] == 0x1F)
     {
-        if(strcmp(FormatNames[i].name, fmtName) == 0)
-        {
-            m_OutputFormat = FormatNames[i].fmt;
-            return true;
-        }
+        bInflated = InflateGzip(archive, archiveSize, binName, contentsName);
+    }
+    else
+    {
+        bInflated = InflateZip(archive, archiveSize, contentsName);
     }
 
-    m_OutputFormat = N64SYM_FMT_DEFAULT;
-    return false;
-}
-
-bool CN64Sym::SetOutputPath(const char *path)
-{
-    m_OutputFile.open(path, std::ofstream::binary);
+#ifndef WIN32
+    if(bArchiveMapped)
+    {
+        munmap(archive, archiveSize);
+    }
+    else
+#endif
+    {
+        delete[] archive;
+    }
 
-    if(!m_OutputFile.is_open())
+    if(!bInflated)
     {
-        m_Output = &std::cout;
+        printf("Error: Could not extract '%s'\n", binName);
+        UnloadBinary();
         return false;
     }
 
-    m_Output = &m_OutputFile;
-    return true;
-}
-
-void CN64Sym::SetHeaderSize(uint32_t headerSize)
-{
-    m_bOverrideHeaderSize = true;
-    m_HeaderSize = headerSize;
+    return ProcessRomHeader(contentsName.c_str());
 }
 
-bool CN64Sym::Run()
+bool CN64Sym::InflateGzip(const uint8_t *archive, size_t archiveSize, const char *binName, std::string& contentsName)
 {
-    if(m_Binary == NULL)
+    // 10 byte header, optional fields, deflate stream, crc32 and size of the contents
+    if(archiveSize < 18)
     {
         return false;
     }
 
-    m_LikelyFunctionOffsets.clear();
+    uint8_t flags = archive[3];
+    size_t offset = 10;
 
-    for(size_t i = 0; i < m_BinarySize; i += sizeof(uint32_t))
+    // name.z64.gz unless the header says otherwise
+    contentsName = binName;
+
+    if(PathIsGzipFile(binName))
     {
-        uint32_t word = bswap32(*(uint32_t*)&m_Binary[i]);
+        contentsName.resize(contentsName.size() - 3);
+    }
 
-        // JR RA (+ 8)
-        if(word == 0x03E00008)
+    if(flags & 0x04) // FEXTRA
+    {
+        if(offset + 2 > archiveSize)
         {
-            if(*(uint32_t*)&m_Binary[i + 8] != 0x00000000)
-            {
-                m_LikelyFunctionOffsets.insert(i + 8);
-            }
+            return false;
         }
 
-        // ADDIU SP, SP, -n
-        if((word & 0xFFFF0000) == 0x27BD0000 && (int16_t)(word & 0xFFFF) < 0)
+        offset += 2 + (archive[offset] | (archive[offset + 1] << 8));
+
+        if(offset > archiveSize)
         {
-            m_LikelyFunctionOffsets.insert(i);
+            return false;
         }
-
-        // todo JALs?
     }
 
-    TallyNumSymbolsToCheck();
-
-    if(m_bUseBuiltinSignatures)
+    if(flags & 0x08) // FNAME
     {
-        ProcessSignatureFile(m_BuiltinSigs);
-    }
+        const uint8_t *name = &archive[offset];
+        size_t length = strnlen((const char *)name, archiveSize - offset);
+        contentsName.assign((const char *)name, length);
+        offset += length + 1;
 
-    for(size_t i = 0; i < m_LibPaths.size(); i++)
-    {
-        ScanRecursive(m_LibPaths.at(i));
+        if(offset > archiveSize)
+        {
+            return false;
+        }
     }
 
-    SortResults();
-    DumpResults();
-
-    return true;
-}
-
-void CN64Sym::DumpResults()
-{
-    switch(m_OutputFormat)
+    if(flags & 0x10) // FCOMMENT
     {
-    case N64SYM_FMT_PJ64:
-        for(auto& result : m_Results)
-        {
-            Output("%08X,code,%s\n", result.address, result.name);
-        }
-        break;
-    case N64SYM_FMT_NEMU:
-        Output("Root\n");
-        Output("\tCPU\n");
-        for(auto& result : m_Results)
-        {
-            Output("\t\tCPU 0x%08X: %s\n", result.address, result.name);
-        }
-        Output("\tMemory\n");
-        Output("\tRSP\n");
-        break;
-    case N64SYM_FMT_ARMIPS:
-        for(auto& result : m_Results)
-        {
-            Output(".definelabel %s, 0x%08X\n", result.name, result.address);
-        }
-        break;
-    case N64SYM_FMT_N64SPLIT:
-        Output("labels:\n");
-        for(auto &result : m_Results)
-        {
-            Output("   - [0x%08X, \"%s\"]\n", result.address, result.name);
-        }
-        break;
-    case N64SYM_FMT_SPLAT:
-        for(auto &result : m_Results)
-        {
-            Output("%s = 0x%08X;\n", result.name, result.address);
-        }
-        break;
-    case N64SYM_FMT_DEFAULT:
-    default:
-        for(auto& result : m_Results)
+        offset += strnlen((const char *)&archive[offset], archiveSize - offset) + 1;
+
+        if(offset > archiveSize)
         {
-            Output("%08X %s\n", result.address, result.name);
+            return false;
         }
-        break;
     }
-}
 
-void CN64Sym::ScanRecursive(const char* path)
-{
-    if (IsFileWithSymbols(path))
+    if(flags & 0x02) // FHCRC
     {
-        ProcessFile(path);
-        return;
-    }
-    DIR *dir;
-    dir = opendir(path);
-    if (dir == NULL)
-    {
-        printf("%s is neither a directory or file with symbols.\n", path);
-        return;
-    }
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL)
-    {
-        char next_path[PATH_MAX];
-        if (!entry->d_name) continue;
-        snprintf(next_path, sizeof(next_path), "%s/%s", path, entry->d_name);
-        switch (entry->d_type) {
-            case DT_DIR:
-                // skip "." dirs
-                if (entry->d_name[0] == '.')
-                {
-                    continue;
-                }
-                // scan subdirectory
-                ScanRecursive(next_path);
-                break;
-            case DT_REG:
-            {
-                if (IsFileWithSymbols(next_path))
-                {
-                    //printf("next path %s\n", next_path);
-                    ProcessFile(next_path);
-                }
-                break;
-            }
-            default:
-                break;
+        offset += 2;
+
+        if(offset > archiveSize)
+        {
+            return false;
         }
     }
-    closedir(dir);
-}
 
-void CN64Sym::ProcessFile(const char* path)
-{
-    if (PathIsStaticLibrary(path))
+    if(offset + 8 > archiveSize)
     {
-        ProcessLibrary(path);
+        return false;
     }
-    else if (PathIsObjectFile(path))
+
+    const uint8_t *trailer = &archive[archiveSize - 8];
+    uint32_t crc = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | ((uint32_t)trailer[3] << 24);
+    uint32_t size = trailer[4] | (trailer[5] << 8) | (trailer[6] << 16) | ((uint32_t)trailer[7] << 24);
+
+    // deflate can't do better than about 1:1032, anything more is a corrupt trailer
+    if(size / 1032 > archiveSize)
     {
-        ProcessObject(path);
+        return false;
     }
-    else if(PathIsSignatureFile(path))
+
+    inflate_output_t output;
+    BeginInflatedOutput(output, size, contentsName.c_str());
+
+    if(!InflateRaw(&archive[offset], archiveSize - 8 - offset, output))
     {
-        ProcessSignatureFile(path);
+        return false;
     }
+
+    crc32_end(&output.crc);
+    return output.crc == crc;
 }
 
-void CN64Sym::ProcessLibrary(const char* path)
+// the first ROM image in the archive, or the first file if there is none
+bool CN64Sym::InflateZip(const uint8_t *archive, size_t archiveSize, std::string& contentsName)
 {
-    CArReader ar;
+    mz_zip_archive zip;
+    memset(&zip, 0, sizeof(zip));
 
-    if(!ar.Load(path))
+    if(!mz_zip_reader_init_mem(&zip, archive, archiveSize, 0))
     {
-        return;
+        return false;
     }
 
-    while(ar.SeekNextBlock())
+    mz_zip_archive_file_stat stat;
+    bool bFound = false;
+    mz_uint numFiles = mz_zip_reader_get_num_files(&zip);
+
+    for(mz_uint i = 0; i < numFiles; i++)
     {
-        if(!PathIsObjectFile(ar.GetBlockIdentifier()))
+        mz_zip_archive_file_stat fileStat;
+
+        if(!mz_zip_reader_file_stat(&zip, i, &fileStat) || fileStat.m_is_directory)
         {
             continue;
         }
 
-        // worker thread will delete objProcessingCtx after it's done
-        obj_processing_context_t* objProcessingCtx = new obj_processing_context_t;
-        objProcessingCtx->mt_this = this;
-        objProcessingCtx->libraryPath = path;
-        objProcessingCtx->blockIdentifier = ar.GetBlockIdentifier();
-        objProcessingCtx->blockData = ar.GetBlockData();
-        objProcessingCtx->blockSize = ar.GetBlockSize();
+        if(!bFound || (PathIsN64Rom(fileStat.m_filename) && !PathIsN64Rom(stat.m_filename)))
+        {
+            stat = fileStat;
+            bFound = true;
+        }
+    }
 
-        m_ThreadPool.AddWorker(ProcessObjectProc, (void*)objProcessingCtx);
+    mz_zip_reader_end(&zip);
+
+    if(!bFound || (stat.m_method != 0 && stat.m_method != MZ_DEFLATED))
+    {
+        return false;
     }
 
-    m_ThreadPool.WaitForWorkers();
-}
+    // the data follows the local header, whose name and extra field may differ from the central directory's
+    size_t offset = stat.m_local_header_ofs;
 
-void CN64Sym::ProcessObject(const char* path)
-{
-    uint8_t* buffer;
-    size_t size;
+    if(offset + 30 > archiveSize)
+    {
+        return false;
+    }
 
-    std::ifstream file;
-    file.open(path, std::ifstream::binary);
+    const uint8_t *localHeader = &archive[offset];
+    offset += 30 + (localHeader[26] | (localHeader[27] << 8)) + (localHeader[28] | (localHeader[29] << 8));
 
-    if(!file.is_open())
+    if(offset > archiveSize || stat.m_comp_size > archiveSize - offset ||
+       stat.m_uncomp_size / 1032 > stat.m_comp_size)
     {
-        return;
+        return false;
     }
 
-    file.seekg(0, file.end);
-    size = file.tellg();
-    buffer = new uint8_t[size];
+    contentsName = stat.m_filename;
 
-    file.seekg(0, file.beg);
-    file.read((char*)buffer, size);
+    inflate_output_t output;
+    BeginInflatedOutput(output, stat.m_uncomp_size, contentsName.c_str());
 
-    Log("%s\n", path);
+    bool bInflated;
 
-    obj_processing_context_t objProcessingCtx;
-    objProcessingCtx.mt_this = NULL;
-    objProcessingCtx.libraryPath = NULL;
-    objProcessingCtx.blockIdentifier = path;
-    objProcessingCtx.blockData = buffer;
-    objProcessingCtx.blockSize = size;
+    if(stat.m_method == 0)
+    {
+        bInflated = WriteInflated(output, &archive[offset], stat.m_comp_size) && output.offset == output.size;
+    }
+    else
+    {
+        bInflated = InflateRaw(&archive[offset], stat.m_comp_size, output);
+    }
 
-    ProcessObject(&objProcessingCtx);
+    crc32_end(&output.crc);
+    return bInflated && output.crc == stat.m_crc32;
+}
 
-    delete[] buffer;
+void CN64Sym::BeginInflatedOutput(inflate_output_t& output, size_t size, const char *contentsName)
+{
+    m_Binary = new uint8_t[size];
+    m_BinarySize = size;
+
+    output.data = m_Binary;
+    output.size = size;
+    output.offset = 0;
+    output.alignedSize = size & ~(size_t)(sizeof(uint32_t) - 1);
+    output.swapMask = 0;
+    output.bNormalize = !m_bOverrideHeaderSize;
+    output.crc = crc32_begin();
 }
 
-void CN64Sym::ProcessObject(obj_processing_context_t* objProcessingCtx)
+bool CN64Sym::InflateRaw(const uint8_t *src, size_t srcSize, inflate_output_t& output)
+{
+    // inflate through the dictionary window rather than into the binary itself,
+    // back-references would otherwise copy bytes that were already swapped
+    tinfl_decompressor inflator;
+    std::vector<uint8_t> window(TINFL_LZ_DICT_SIZE);
+    size_t windowOffset = 0;
+    size_t srcOffset = 0;
+
+    tinfl_init(&inflator);
+
+    while(true)
+    {
+        size_t inSize = srcSize - srcOffset;
+        size_t outSize = TINFL_LZ_DICT_SIZE - windowOffset;
+
+        tinfl_status status = tinfl_decompress(&inflator, &src[srcOffset], &inSize,
+            window.data(), &window[windowOffset], &outSize, 0);
+
+        srcOffset += inSize;
+
+        if(!WriteInflated(output, &window[windowOffset], outSize))
+        {
+            return false;
+        }
+
+        windowOffset = (windowOffset + outSize) & (TINFL_LZ_DICT_SIZE - 1);
+
+        if(status == TINFL_STATUS_DONE)
+        {
+            return output.offset == output.size;
+        }
+
+        // the whole stream was passed in, so needing more input means it's truncated
+        if(status != TINFL_STATUS_HAS_MORE_OUTPUT)
+        {
+            return false;
+        }
+    }
+}
+
+bool CN64Sym::WriteInflated(inflate_output_t& output, const uint8_t *src, size_t size)
+{
+    if(size > output.size - output.offset)
+    {
+        return false;
+    }
+
+    crc32_read(src, size, &output.crc);
+
+    // the first block out of the inflator holds the header unless the whole file is smaller than a word
+    if(output.offset == 0 && output.bNormalize && size >= sizeof(uint32_t))
+    {
+        DetectRomByteOrder(src, &output.swapMask);
+    }
+
+    if(output.swapMask == 0)
+    {
+        memcpy(&output.data[output.offset], src, size);
+        output.offset += size;
+        return true;
+    }
+
+    for(size_t i = 0; i < size; i++)
+    {
+        size_t offset = output.offset + i;
+        output.data[offset < output.alignedSize ? (offset ^ output.swapMask) : offset] = src[i];
+    }
+
+    output.offset += size;
+    return true;
+}
+
+// binName is only needed for ROM images whose header isn't recognized
+bool CN64Sym::ProcessRomHeader(const char *binName)
+{
+    if(m_bOverrideHeaderSize)
+    {
+        return true;
+    }
+
+    uint32_t swapMask = 0;
+    bool bRomHeader = (m_BinarySize >= sizeof(uint32_t) && DetectRomByteOrder(m_Binary, &swapMask));
+
+    if(!bRomHeader && !PathIsN64Rom(binName))
+    {
+        return true;
+    }
+
+    if(m_BinarySize < 0x101000)
+    {
+        UnloadBinary();
+        return false;
+    }
+
+    switch(swapMask)
+    {
+    case 3:
+        NormalizeBinary(true);
+        break;
+    case 1:
+        NormalizeBinary(false);
+        break;
+    }
+
+    uint32_t entryPoint = bswap32(*(uint32_t *)&m_Binary[0x08]);
+
+    uint32_t bootCheck = crc32_begin();
+    crc32_read(&m_Binary[0x40], 0xFC0, &bootCheck);
+    crc32_end(&bootCheck);
+
+    switch(bootCheck)
+    {
+    case 0x0B050EE0: // 6103
+        entryPoint -= 0x100000;
+        break;
+    case 0xACC8580A: // 6106
+        entryPoint -= 0x200000;
+        break;
+    }
+    
+    m_HeaderSize = entryPoint - 0x1000;
+
+    return true;
+}
+
+// the first word of a ROM image in any of the three byte orders
+bool CN64Sym::DetectRomByteOrder(const uint8_t *header, uint32_t *swapMask)
+{
+    uint32_t endianCheck = (header[0] << 24) | (header[1] << 16) | (header[2] << 8) | header[3];
+
+    switch(endianCheck)
+    {
+    case 0x80371240: // .z64
+        *swapMask = 0;
+        return true;
+    case 0x40123780: // .n64
+        *swapMask = 3;
+        return true;
+    case 0x37804012: // .v64
+        *swapMask = 1;
+        return true;
+    }
+
+    return false;
+}
+
+void CN64Sym::NormalizeBinary(bool bWordSwapped)
+{
+    // split the image into one chunk per worker, aligned to whole words
+    size_t numChunks = m_ThreadPool.GetNumCPUCores();
+    size_t alignedSize = m_BinarySize & ~(size_t)(sizeof(uint32_t) - 1);
+    size_t chunkSize = (alignedSize / numChunks + N64SYM_SWAP_CHUNK_ALIGN - 1) & ~(size_t)(N64SYM_SWAP_CHUNK_ALIGN - 1);
+    std::vector<swap_chunk_t> chunks;
+
+    for(size_t offset = 0; offset < alignedSize; offset += chunkSize)
+    {
+        swap_chunk_t chunk;
+        chunk.data = &m_Binary[offset];
+        chunk.size = std::min(chunkSize, alignedSize - offset);
+        chunk.bWordSwapped = bWordSwapped;
+        chunks.push_back(chunk);
+    }
+
+    for(auto& chunk : chunks)
+    {
+        m_ThreadPool.AddWorker(NormalizeChunkProc, (void *)&chunk);
+    }
+
+    m_ThreadPool.WaitForWorkers();
+}
+
+void* CN64Sym::NormalizeChunkProc(void* _chunk)
+{
+    swap_chunk_t* chunk = (swap_chunk_t*)_chunk;
+    uint32_t* words = (uint32_t*)chunk->data;
+    size_t numWords = chunk->size / sizeof(uint32_t);
+
+    // plain loops over whole words so that the compiler can vectorize them
+    if(chunk->bWordSwapped)
+    {
+        for(size_t i = 0; i < numWords; i++)
+        {
+            words[i] = bswap32(words[i]);
+        }
+    }
+    else
+    {
+        for(size_t i = 0; i < numWords; i++)
+        {
+            uint32_t word = words[i];
+            words[i] = ((word & 0x00FF00FF) << 8) | ((word >> 8) & 0x00FF00FF);
+        }
+    }
+
+    return NULL;
+}
+
+void CN64Sym::AddLibPath(const char* libPath)
+{
+    m_LibPaths.push_back(libPath);
+}
+
+// read right away, so that the same file may be used as an output
+bool CN64Sym::AddKnownSymbols(const char *path)
+{
+    std::ifstream file;
+    file.open(path, std::ifstream::binary);
+
+    if(!file.is_open())
+    {
+        return false;
+    }
+
+    std::string line;
+
+    while(std::getline(file, line))
+    {
+        known_symbol_t known;
+
+        if(ParseKnownSymbol(line.c_str(), known))
+        {
+            known.source = path;
+            m_KnownSymbols.push_back(known);
+        }
+    }
+
+    return true;
+}
+
+void CN64Sym::SetVerbose(bool bVerbose)
+{
+    m_bVerbose = bVerbose;
+}
+
+void CN64Sym::UseBuiltinSignatures(bool bUseBuiltinSignatures)
+{
+    m_bUseBuiltinSignatures = bUseBuiltinSignatures;
+}
+
+void CN64Sym::SetThoroughScan(bool bThoroughScan)
+{
+    m_bThoroughScan = bThoroughScan;
+}
+
+// applies to the outputs added after it, like n64sig's -f
+bool CN64Sym::SetOutputFormat(const char *fmtName)
+{
+    for(size_t i = 0; i < sizeof(FormatNames) / sizeof(FormatNames[0]); i++)
+    {
+        if(strcmp(FormatNames[i].name, fmtName) == 0)
+        {
+            m_OutputFormat = FormatNames[i].fmt;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool CN64Sym::AddOutputPath(const char *path)
+{
+    FILE *file = fopen(path, "wb");
+
+    if(file == NULL)
+    {
+        return false;
+    }
+
+    AddOutputFile(file);
+    m_Outputs.back().bOwnFile = true;
+    return true;
+}
+
+void CN64Sym::AddOutputFile(FILE *file)
+{
+    output_target_t output;
+    output.format = m_OutputFormat;
+    output.file = file;
+    output.bOwnFile = false;
+    m_Outputs.push_back(output);
+}
+
+void CN64Sym::SetHeaderSize(uint32_t headerSize)
+{
+    m_bOverrideHeaderSize = true;
+    m_HeaderSize = headerSize;
+}
+
+void CN64Sym::SetDumpResults(bool bDumpResults)
+{
+    m_bDumpResults = bDumpResults;
+}
+
+// "-" streams to stdout
+bool CN64Sym::SetStreamPath(const char *path)
+{
+    if(strcmp(path, "-") == 0)
+    {
+        SetStreamFile(stdout);
+        return true;
+    }
+
+    FILE *file = fopen(path, "wb");
+
+    if(file == NULL)
+    {
+        return false;
+    }
+
+    SetStreamFile(file);
+    m_bOwnStreamFile = true;
+    return true;
+}
+
+void CN64Sym::SetStreamFile(FILE *file)
+{
+    if(m_bOwnStreamFile)
+    {
+        fclose(m_StreamFile);
+        m_bOwnStreamFile = false;
+    }
+
+    m_StreamFile = file;
+
+    if(file == stdout)
+    {
+        // the progress line would end up in the stream
+        m_bShowProgress = false;
+    }
+}
+
+void CN64Sym::SetShowProgress(bool bShowProgress)
+{
+    m_bShowProgress = bShowProgress;
+}
+
+void CN64Sym::SetNumThreads(int numThreads)
+{
+    m_ThreadPool.SetNumWorkers(numThreads);
+}
+
+void CN64Sym::SetSessionPath(const char *path)
+{
+    m_SessionPath = path;
+    m_bUseSession = true;
+}
+
+// keeps a session in memory without a file, see GetSession()
+void CN64Sym::UseSession(bool bUseSession)
+{
+    m_bUseSession = bUseSession;
+}
+
+void CN64Sym::SetPreviousSession(const CScanSession& session)
+{
+    m_PrevSession = session;
+    m_bHavePrevSession = true;
+    m_bUseSession = true;
+}
+
+const CScanSession& CN64Sym::GetSession()
+{
+    return m_Session;
+}
+
+size_t CN64Sym::GetNumChangedPages()
+{
+    if(!m_bIncremental)
+    {
+        return (m_BinarySize + SCANSESSION_PAGE_SIZE - 1) / SCANSESSION_PAGE_SIZE;
+    }
+
+    return m_ChangedPageCounts.back();
+}
+
+void CN64Sym::SetSignatureIndex(CSignatureIndex *index)
+{
+    m_Index = index;
+}
+
+size_t CN64Sym::GetNumResults()
+{
+    return m_Results.size();
+}
+
+uint32_t CN64Sym::GetResultAddress(size_t nResult)
+{
+    if(nResult >= m_Results.size())
+    {
+        return 0;
+    }
+
+    return m_Results[nResult].address;
+}
+
+const char *CN64Sym::GetResultName(size_t nResult)
+{
+    if(nResult >= m_Results.size())
+    {
+        return NULL;
+    }
+
+    return m_Results[nResult].name;
+}
+
+size_t CN64Sym::GetNumCandidateTests()
+{
+    return m_NumCandidateTests;
+}
+
+uint32_t CN64Sym::GetHeaderSize()
+{
+    return m_HeaderSize;
+}
+
+size_t CN64Sym::GetBinarySize()
+{
+    return m_BinarySize;
+}
+
+bool CN64Sym::Run()
+{
+    if(m_Binary == NULL)
+    {
+        return false;
+    }
+
+    m_DataReferences.clear();
+    m_MatchedOffsets.clear();
+    m_NumCandidateTests = 0;
+
+    // the part that wasn't searched while it was being read
+    FindLikelyFunctions(m_BinarySize);
+
+    if(m_Index == &m_OwnIndex && !m_bOwnIndexLoaded)
+    {
+        LoadOwnIndex();
+    }
+
+    TallyNumSymbolsToCheck();
+
+    if(m_bUseSession)
+    {
+        BeginIncrementalScan();
+    }
+
+    AddKnownResults();
+
+    // every result was carried over if nothing changed
+    bool bSearch = !m_bIncremental || m_ChangedPageCounts.back() != 0;
+    CSignatureFile *builtinSigs = m_bUseBuiltinSignatures ? m_Index->GetBuiltinSignatures() : NULL;
+
+    if(bSearch && builtinSigs != NULL)
+    {
+        m_CurrentSource = "built-in";
+        ProcessSignatureFile(*builtinSigs);
+    }
+
+    for(size_t nEntry = 0; bSearch && nEntry < m_Index->GetNumEntries(); nEntry++)
+    {
+        ProcessIndexEntry(m_Index->GetEntry(nEntry));
+    }
+
+    if(bSearch && builtinSigs != NULL)
+    {
+        // after the libraries so that their references can be used too
+        m_CurrentSource = "built-in";
+        ProcessDataSignatures(*builtinSigs);
+    }
+
+    for(auto& shadow : m_CarriedShadows)
+    {
+        m_ClaimOffset = shadow.claimOffset;
+        m_ClaimSize = shadow.claimSize;
+        AddResult(shadow);
+    }
+
+    SortResults();
+
+    if(m_bUseSession)
+    {
+        EndSession();
+    }
+
+    if(m_bDumpResults)
+    {
+        DumpResults();
+    }
+
+    return true;
+}
+
+// continues the search from m_LikelyFunctionsEnd, the words from there up to end must be final
+void CN64Sym::FindLikelyFunctions(size_t end)
+{
+    size_t i = m_LikelyFunctionsEnd;
+
+    // mapped binaries may not be read past their end
+    for(; i + sizeof(uint32_t) <= end; i += sizeof(uint32_t))
+    {
+        uint32_t word = bswap32(*(uint32_t*)&m_Binary[i]);
+
+        // JR RA (+ 8)
+        if(word == 0x03E00008 && i + 12 <= m_BinarySize)
+        {
+            if(*(uint32_t*)&m_Binary[i + 8] != 0x00000000)
+            {
+                m_LikelyFunctionOffsets.insert(i + 8);
+            }
+        }
+
+        // ADDIU SP, SP, -n
+        if((word & 0xFFFF0000) == 0x27BD0000 && (int16_t)(word & 0xFFFF) < 0)
+        {
+            m_LikelyFunctionOffsets.insert(i);
+        }
+
+        // todo JALs?
+    }
+
+    m_LikelyFunctionsEnd = i;
+}
+
+void CN64Sym::DumpResults()
+{
+    if(m_Outputs.empty())
+    {
+        if(m_StreamFile == stdout)
+        {
+            // stdout already has the results as NDJSON
+            return;
+        }
+
+        CBufferedWriter out(stdout);
+        DumpResults(out, m_OutputFormat);
+        out.Flush();
+        fflush(stdout);
+        return;
+    }
+
+    for(auto& output : m_Outputs)
+    {
+        CBufferedWriter out(output.file);
+        DumpResults(out, output.format);
+
+        if(!out.Flush() || fflush(output.file) != 0)
+        {
+            Message("Error: Failed to write results\n");
+        }
+    }
+}
+
+void CN64Sym::DumpResults(CBufferedWriter& out, n64sym_output_fmt_t format)
+{
+    switch(format)
+    {
+    case N64SYM_FMT_PJ64:
+        for(auto& result : m_Results)
+        {
+            out.WriteHex(result.address, 8);
+            out.WriteString(result.bData ? ",data," : ",code,");
+            out.WriteString(result.name);
+            out.Write("\n", 1);
+        }
+        break;
+    case N64SYM_FMT_NEMU:
+        out.WriteString("Root\n");
+        out.WriteString("\tCPU\n");
+        for(auto& result : m_Results)
+        {
+            out.WriteString("\t\tCPU 0x");
+            out.WriteHex(result.address, 8);
+            out.WriteString(": ");
+            out.WriteString(result.name);
+            out.Write("\n", 1);
+        }
+        out.WriteString("\tMemory\n");
+        out.WriteString("\tRSP\n");
+        break;
+    case N64SYM_FMT_ARMIPS:
+        for(auto& result : m_Results)
+        {
+            out.WriteString(".definelabel ");
+            out.WriteString(result.name);
+            out.WriteString(", 0x");
+            out.WriteHex(result.address, 8);
+            out.Write("\n", 1);
+        }
+        break;
+    case N64SYM_FMT_N64SPLIT:
+        out.WriteString("labels:\n");
+        for(auto &result : m_Results)
+        {
+            out.WriteString("   - [0x");
+            out.WriteHex(result.address, 8);
+            out.WriteString(", \"");
+            out.WriteString(result.name);
+            out.WriteString("\"]\n");
+        }
+        break;
+    case N64SYM_FMT_SPLAT:
+        for(auto &result : m_Results)
+        {
+            out.WriteString(result.name);
+            out.WriteString(" = 0x");
+            out.WriteHex(result.address, 8);
+            out.WriteString(";\n");
+        }
+        break;
+    case N64SYM_FMT_DEFAULT:
+    default:
+        for(auto& result : m_Results)
+        {
+            out.WriteHex(result.address, 8);
+            out.Write(" ", 1);
+            out.WriteString(result.name);
+            out.Write("\n", 1);
+        }
+        break;
+    }
+}
+
+void CN64Sym::LoadOwnIndex()
+{
+    if(m_bUseBuiltinSignatures)
+    {
+        m_OwnIndex.LoadBuiltinSignatures();
+    }
+
+    for(size_t i = 0; i < m_LibPaths.size(); i++)
+    {
+        m_OwnIndex.AddPath(m_LibPaths.at(i));
+    }
+
+    m_bOwnIndexLoaded = true;
+}
+
+void CN64Sym::ProcessIndexEntry(const CSignatureIndex::entry_t* entry)
+{
+    switch(entry->type)
+    {
+    case SIGINDEX_SIGNATURE_FILE:
+        m_CurrentSource = entry->path.c_str();
+        ProcessSignatureFile(*entry->sigFile);
+        ProcessDataSignatures(*entry->sigFile);
+        break;
+    case SIGINDEX_LIBRARY:
+        ProcessLibrary(entry);
+        break;
+    case SIGINDEX_OBJECT:
+    {
+        const CSignatureIndex::object_t& object = entry->objects[0];
+
+        Log("%s\n", object.identifier.c_str());
+
+        obj_processing_context_t objProcessingCtx;
+        objProcessingCtx.mt_this = NULL;
+        objProcessingCtx.libraryPath = NULL;
+        objProcessingCtx.blockIdentifier = object.identifier.c_str();
+        objProcessingCtx.blockData = object.data.data();
+        objProcessingCtx.blockSize = object.data.size();
+
+        ProcessObject(&objProcessingCtx);
+        break;
+    }
+    }
+}
+
+void CN64Sym::ProcessLibrary(const CSignatureIndex::entry_t* entry)
+{
+    for(auto& object : entry->objects)
+    {
+        // worker thread will delete objProcessingCtx after it's done
+        obj_processing_context_t* objProcessingCtx = new obj_processing_context_t;
+        objProcessingCtx->mt_this = this;
+        objProcessingCtx->libraryPath = entry->path.c_str();
+        objProcessingCtx->blockIdentifier = object.identifier.c_str();
+        objProcessingCtx->blockData = object.data.data();
+        objProcessingCtx->blockSize = object.data.size();
+
+        m_ThreadPool.AddWorker(ProcessObjectProc, (void*)objProcessingCtx);
+    }
+
+    m_ThreadPool.WaitForWorkers();
+}
+
+void CN64Sym::ProcessObject(obj_processing_context_t* objProcessingCtx)
 {
     CElfContext elf;
-    elf.LoadFromMemory(objProcessingCtx->blockData, objProcessingCtx->blockSize);
+    elf.LoadFromMemory((uint8_t*)objProcessingCtx->blockData, objProcessingCtx->blockSize);
+
+    CElfSection* textSec = elf.Section(".text");
+
+    if(textSec == NULL)
+    {
+        return;
+    }
+
+    const char* textBuf = textSec->Data(&elf);
+    uint32_t textSize = textSec->Size();
+
+    if(textSize > m_BinarySize || IsObjectResolved(&elf))
+    {
+        return;
+    }
+
+    uint32_t endAddress = m_BinarySize - textSize;
+
+    bool bHaveFullMatch = false;
+    uint32_t matchedAddress = 0;
+    int nBytesMatched;
+    int bestPartialMatchLength = 0;
+    const char* matchedBlock = NULL;
+    size_t numTests = 0;
+
+    for(uint32_t blockAddress = 0; blockAddress < endAddress; blockAddress += sizeof(uint32_t))
+    {
+        if(!IsRangeChanged(blockAddress, textSize))
+        {
+            continue;
+        }
+
+        const char* block = (const char*)&m_Binary[blockAddress];
+        numTests++;
+        bHaveFullMatch = TestElfObjectText(&elf, block, &nBytesMatched);
+
+        if(bHaveFullMatch)
+        {
+            matchedBlock = block;
+            matchedAddress = blockAddress;
+            break;
+        }
+        else if(nBytesMatched > bestPartialMatchLength)
+        {
+            matchedBlock = block;
+            matchedAddress = blockAddress;
+            bestPartialMatchLength = nBytesMatched;
+        }
+    }
+
+    if(numTests == 0)
+    {
+        // every offset is in pages that did not change
+        return;
+    }
+
+    m_ThreadPool.LockDefaultMutex();
+
+    m_NumCandidateTests += numTests;
+
+    const char* source = objProcessingCtx->libraryPath != NULL ? objProcessingCtx->libraryPath : objProcessingCtx->blockIdentifier;
+
+    Log("%s:%s\n", objProcessingCtx->libraryPath, objProcessingCtx->blockIdentifier);
+
+    m_ClaimOffset = matchedAddress;
+    m_ClaimSize = bHaveFullMatch ? textSize : bestPartialMatchLength;
+
+    if(bHaveFullMatch)
+    {
+        Log("complete match\n");
+        AddSymbolResults(&elf, source, matchedAddress);
+        AddRelocationResults(&elf, source, matchedBlock, "__"); // fix me altNamePrefix
+    }
+    else if(bestPartialMatchLength >= N64SYM_MIN_PARTIAL_MATCH)
+    {
+        Log("partial match (0x%02X bytes)\n", bestPartialMatchLength);
+        AddSymbolResults(&elf, source, matchedAddress, bestPartialMatchLength);
+        AddRelocationResults(&elf, source, matchedBlock, "__", bestPartialMatchLength); // fix me altNamePrefix
+    }
+    else
+    {
+        m_ThreadPool.UnlockDefaultMutex();
+        return;
+    }
+
+    for(size_t i = 0; i < textSize; i += 4)
+    {
+        uint32_t buffOp = bswap32(*(uint32_t*)&matchedBlock[i]);
+        uint32_t textOp = bswap32(*(uint32_t*)&textBuf[i]);
+
+        CElfRelocation* relocation = NULL;
+        CElfSymbol* symbol = NULL;
+        bool bHaveRel = false;
+
+        for(int j = 0; j < elf.NumTextRelocations(); j++)
+        {
+            relocation = elf.TextRelocation(j);
+            if(relocation->Offset() == i)
+            {
+                Log("have reloc\n");
+                symbol = relocation->Symbol(&elf);
+                bHaveRel = true;
+            }
+        }
+
+        Log("%08X/%04X: %08X %08X", m_HeaderSize + (matchedAddress + i), i, buffOp, textOp);
+        textOp == buffOp ? Log("\n") : Log(" * %s\n", bHaveRel ? symbol->Name(&elf) : "");
+    }
+
+    Log("\n");
+    m_ThreadPool.UnlockDefaultMutex();
+}
+
+void* CN64Sym::ProcessObjectProc(void* _objProcessingCtx)
+{
+    obj_processing_context_t* objProcessingCtx = (obj_processing_context_t*)_objProcessingCtx;
+    CN64Sym* _this = objProcessingCtx->mt_this;
+
+    _this->ProcessObject(objProcessingCtx);
+
+    delete objProcessingCtx;
+
+    return NULL;
+}
+
+void CN64Sym::GetScanOrder(CSignatureFile& sigFile, std::vector<size_t>& order)
+{
+    // specific signatures first so that they claim their addresses before
+    // the ambiguous ones are tried, file order otherwise
+
+    order.clear();
+
+    for(size_t nSymbol = 0; nSymbol < sigFile.GetNumSymbols(); nSymbol++)
+    {
+        if(!sigFile.IsDataSymbol(nSymbol))
+        {
+            order.push_back(nSymbol);
+        }
+    }
+
+    std::stable_sort(order.begin(), order.end(), [&sigFile](size_t a, size_t b){
+        bool aLowEntropy = sigFile.IsLowEntropySymbol(a);
+        bool bLowEntropy = sigFile.IsLowEntropySymbol(b);
+
+        if(aLowEntropy != bLowEntropy)
+        {
+            return bLowEntropy;
+        }
+
+        return (sigFile.GetSymbolCrcAShared(a) + sigFile.GetSymbolPrefixShared(a)) <
+               (sigFile.GetSymbolCrcAShared(b) + sigFile.GetSymbolPrefixShared(b));
+    });
+}
+
+void CN64Sym::ProcessSignatureFile(CSignatureFile& sigFile)
+{
+    std::vector<size_t> order;
+    GetScanOrder(sigFile, order);
+
+    size_t numSymbols = order.size();
+
+    std::vector<partial_match_t> partialMatches;
+
+    const char *statusDescription = "(built-in signatures)";
+    int percentDone = 0;
+    int statusLineLen = m_bShowProgress ? printf("[  0%%] %s", statusDescription) : 0;
+
+    for(size_t nOrder = 0; nOrder < numSymbols; nOrder++)
+    {
+        size_t nSymbol = order[nOrder];
+        uint32_t symbolSize = sigFile.GetSymbolSize(nSymbol);
+
+        if(symbolSize > m_BinarySize || IsSymbolResolved(sigFile, nSymbol))
+        {
+            continue;
+        }
+
+        uint32_t endOffset = m_BinarySize - symbolSize;
+
+        // ambiguous signatures may not take an address from an earlier match,
+        // low entropy ones are only tried where functions are likely to start
+        bool bAmbiguous = sigFile.IsAmbiguousSymbol(nSymbol);
+        bool bLowEntropy = sigFile.IsLowEntropySymbol(nSymbol);
+
+        int percentNow = (int)(((float)nOrder / numSymbols) * 100);
+        if(m_bShowProgress && percentNow > percentDone)
+        {
+            ClearLine(statusLineLen);
+            statusLineLen = printf("[%3d%%] %s", percentDone, statusDescription);
+            percentDone = percentNow;
+        }
+
+        partial_match_t bestPartialMatch;
+        bestPartialMatch.nBytesMatched = 0;
+
+        for(auto offset : m_LikelyFunctionOffsets)
+        {
+            if(offset > endOffset)
+            {
+                break;
+            }
+
+            if(!IsRangeChanged(offset, symbolSize))
+            {
+                continue;
+            }
+
+            uint32_t nBytesMatched;
+
+            if(TestSignatureSymbol(sigFile, nSymbol, offset, &nBytesMatched, bAmbiguous))
+            {
+                goto next_symbol;
+            }
+
+            if((int)nBytesMatched > bestPartialMatch.nBytesMatched)
+            {
+                bestPartialMatch.address = offset;
+                bestPartialMatch.nBytesMatched = nBytesMatched;
+            }
+        }
+
+        if(m_bThoroughScan && !bLowEntropy)
+        {
+            for(uint32_t offset = 0; offset < endOffset; offset += 4)
+            {
+                if(!IsRangeChanged(offset, symbolSize))
+                {
+                    continue;
+                }
+
+                uint32_t nBytesMatched;
+
+                if(TestSignatureSymbol(sigFile, nSymbol, offset, &nBytesMatched, bAmbiguous))
+                {
+                    goto next_symbol;
+                }
+
+                if((int)nBytesMatched > bestPartialMatch.nBytesMatched)
+                {
+                    bestPartialMatch.address = offset;
+                    bestPartialMatch.nBytesMatched = nBytesMatched;
+                }
+            }
+        }
+
+        if(!bLowEntropy && bestPartialMatch.nBytesMatched >= N64SYM_MIN_PARTIAL_MATCH)
+        {
+            bestPartialMatch.nSymbol = nSymbol;
+            partialMatches.push_back(bestPartialMatch);
+        }
+
+        next_symbol:;
+    }
+
+    if(m_bShowProgress)
+    {
+        ClearLine(statusLineLen);
+    }
+
+    // partial matches only claim addresses that no complete match took
+    for(auto& partialMatch : partialMatches)
+    {
+        char symbolName[128];
+        sigFile.GetSymbolName(partialMatch.nSymbol, symbolName, sizeof(symbolName));
+
+        if(HaveResultNamed(symbolName))
+        {
+            // another version of this symbol matched completely
+            continue;
+        }
+
+        Log("%s: partial match (0x%02X bytes)\n", symbolName, partialMatch.nBytesMatched);
+
+        AddSignatureResults(sigFile, partialMatch.nSymbol, partialMatch.address, partialMatch.nBytesMatched);
+    }
+}
+
+bool CN64Sym::TestElfObjectText(CElfContext* elf, const char* data, int* nBytesMatched)
+{
+    CElfSection *text_sec, *rel_text_sec;
+    CElfRelocation* text_relocations;
+    const char* text_sec_data;
+    uint32_t text_sec_size;
+    int num_text_relocations;
+
+    text_sec = elf->Section(".text");
+
+    if(text_sec == NULL)
+    {
+        *nBytesMatched = 0;
+        return false;
+    }
+
+    text_sec_data = text_sec->Data(elf);
+    text_sec_size = text_sec->Size();
+    num_text_relocations = elf->NumTextRelocations();
+
+    if(num_text_relocations == 0)
+    {
+        // no relocations, do plain binary comparison
+        if(memcmp(text_sec_data, data, text_sec_size) == 0)
+        {
+            *nBytesMatched = text_sec_size;
+            return true;
+        }
+        
+        *nBytesMatched = 0;
+        return false;
+    }
+
+    rel_text_sec = elf->Section(".rel.text");
+    text_relocations = (CElfRelocation*) rel_text_sec->Data(elf);
+
+    int cur_reltab_index = 0;
+    
+    for(uint32_t i = 0; i < text_sec_size; i += sizeof(uint32_t))
+    {
+        // see if this opcode has a relocation
+
+        CElfRelocation* curRelocation = &text_relocations[cur_reltab_index];
+
+        if(cur_reltab_index < num_text_relocations && i == curRelocation->Offset())
+        {
+            // if for some reason the relocation is on a NOP, don't count it
+            if(data[i] == 0x00000000)
+            {
+                *nBytesMatched = i;
+                return false;
+            }
+
+            // only check the top 6 bits
+            if((text_sec_data[i] & 0xFC) != (data[i] & 0xFC))
+            {
+                *nBytesMatched = i;
+                return false;
+            }
+
+            cur_reltab_index++;
+            continue;
+        }
+
+        // fetch the next relocation
+        // this trusts that the object's relocation offsets are in order from least to greatest
+        //for(int j = cur_reltab_index; j < num_text_relocations; j++)
+        //{
+        //    CElfRelocation* cur_relocation = &text_relocations[j];
+        //    cur_relocation_offset = cur_relocation->Offset();
+        //    
+        //    if(cur_relocation_offset < i)
+        //    {
+        //        continue;
+        //    }
+//
+        //    if(cur_relocation_offset == i)
+        //    {
+        //        have_relocation = true;
+        //    }
+        //}
+
+        if(*(uint32_t*)&text_sec_data[i] != *(uint32_t*)&data[i])
+        {
+            *nBytesMatched = i;
+            return false;
+        }
+    }
+    return true;
+}
 
-    CElfSection* textSec = elf.Section(".text");
+bool CN64Sym::TestSignatureSymbol(CSignatureFile& sigFile, size_t nSymbol, uint32_t offset, uint32_t* nBytesMatched, bool bUnclaimedOnly)
+{
+    m_NumCandidateTests++;
 
-    if(textSec == NULL)
+    if(sigFile.TestSymbol(nSymbol, &m_Binary[offset], nBytesMatched))
     {
-        return;
+        if(bUnclaimedOnly && m_MatchedOffsets.count(offset) != 0)
+        {
+            // another signature already matched here
+            if(nBytesMatched != NULL)
+            {
+                *nBytesMatched = 0;
+            }
+            return false;
+        }
+
+        m_MatchedOffsets.insert(offset);
+        AddSignatureResults(sigFile, nSymbol, offset);
+        return true;
     }
+    return false;
+}
 
-    const char* textBuf = textSec->Data(&elf);
-    uint32_t textSize = textSec->Size();
+void CN64Sym::AddSignatureResults(CSignatureFile& sigFile, size_t nSymbol, uint32_t offset, uint32_t maxOffset)
+{
+    typedef struct { uint32_t address; bool haveHi16; bool haveLo16; } test_t;
+    std::map<std::string, test_t> relocMap;
 
-    uint32_t endAddress = m_BinarySize - textSize;
+    // -1 for the symbol's own name and relocations, otherwise an alias
+    std::vector<bool> conflicts(sigFile.GetNumAliases(nSymbol) + 1, false);
+    int nVariant = -1;
 
-    bool bHaveFullMatch;
-    uint32_t matchedAddress;
-    int nBytesMatched;
-    int bestPartialMatchLength = 0;
-    const char* matchedBlock = NULL;
+    if(sigFile.HaveAliasRelocs(nSymbol))
+    {
+        nVariant = SelectVariant(sigFile, nSymbol, offset, conflicts);
+    }
 
-    for(uint32_t blockAddress = 0; blockAddress < endAddress; blockAddress += sizeof(uint32_t))
+    m_ClaimOffset = offset;
+    m_ClaimSize = maxOffset > 0 ? maxOffset : sigFile.GetSymbolSize(nSymbol);
+
+    search_result_t result;
+    result.address = m_HeaderSize + offset;
+    result.size = sigFile.GetSymbolSize(nSymbol);
+    result.bData = sigFile.IsDataSymbol(nSymbol);
+    result.kind = result.bData ? N64SYM_MATCH_DATA : (maxOffset > 0 ? N64SYM_MATCH_PARTIAL : N64SYM_MATCH_COMPLETE);
+    result.source = m_CurrentSource;
+
+    if(nVariant == -1)
     {
-        const char* block = (const char*)&m_Binary[blockAddress];
-        bHaveFullMatch = TestElfObjectText(&elf, block, &nBytesMatched);
+        sigFile.GetSymbolName(nSymbol, result.name, sizeof(result.name));
+    }
+    else
+    {
+        sigFile.GetAliasName(nSymbol, nVariant, result.name, sizeof(result.name));
+    }
 
-        if(bHaveFullMatch)
+    if(!AddResult(result) && result.bData)
+    {
+        // data addresses are often claimed by a name derived from a relocation first
+        AddAliasResult(result);
+    }
+
+    // other symbols with the same body share the address,
+    // unless their relocations contradict the results so far
+    for(int nOther = -1; nOther < (int)sigFile.GetNumAliases(nSymbol); nOther++)
+    {
+        if(nOther == nVariant || conflicts[nOther + 1])
         {
-            matchedBlock = block;
-            matchedAddress = blockAddress;
+            continue;
+        }
+
+        search_result_t aliasResult = result;
+        aliasResult.kind = N64SYM_MATCH_ALIAS;
+
+        if(nOther == -1)
+        {
+            sigFile.GetSymbolName(nSymbol, aliasResult.name, sizeof(aliasResult.name));
+        }
+        else
+        {
+            sigFile.GetAliasName(nSymbol, nOther, aliasResult.name, sizeof(aliasResult.name));
+        }
+
+        AddAliasResult(aliasResult);
+    }
+
+    // add results from relocations
+    for(size_t nReloc = 0; nReloc < sigFile.GetNumRelocs(nSymbol); nReloc++)
+    {
+        char relocName[128];
+        GetVariantRelocName(sigFile, nSymbol, nVariant, nReloc, relocName, sizeof(relocName));
+        uint8_t relocType = sigFile.GetRelocType(nSymbol, nReloc);
+        uint32_t relocOffset = sigFile.GetRelocOffset(nSymbol, nReloc);
+
+        if(maxOffset > 0 && relocOffset >= maxOffset)
+        {
+            // exceeds maximum offset for a partial match
+            continue;
+        }
+
+        uint32_t opcode = bswap32(*(uint32_t*)&m_Binary[offset + relocOffset]);
+
+        switch(relocType)
+        {
+        case R_MIPS_HI16:
+            if(relocMap.count(relocName) == 0)
+            {
+                relocMap[relocName].haveHi16 = true;
+                relocMap[relocName].haveLo16 = false;
+            }
+            relocMap[relocName].address = (opcode & 0x0000FFFF) << 16;
+            break;
+        case R_MIPS_LO16:
+            if(relocMap.count(relocName) != 0)
+            {
+                relocMap[relocName].address += (int16_t)(opcode & 0x0000FFFF);
+                m_DataReferences.push_back(relocMap[relocName].address);
+            }
+            else
+            {
+                // lo16 without a hi16, nothing to add it to
+                Log("missing hi16 for %s\n", relocName);
+            }
+            break;
+        case R_MIPS_26:
+            relocMap[relocName].address = (m_HeaderSize & 0xF0000000) + ((opcode & 0x03FFFFFF) << 2);
+            break;
+        case R_MIPS_32:
+            // pointer in a data object
+            relocMap[relocName].address = opcode;
+            m_DataReferences.push_back(opcode);
             break;
         }
-        else if(nBytesMatched > bestPartialMatchLength)
+
+        //printf("%s %02X %04X\n", relocName, relocType, relocOffset);
+    }
+
+    for(auto& i : relocMap)
+    {
+        search_result_t relocResult;
+        relocResult.address = i.second.address;
+        relocResult.size = 0;
+        relocResult.bData = false;
+        relocResult.kind = N64SYM_MATCH_RELOCATION;
+        relocResult.source = m_CurrentSource;
+        strncpy(relocResult.name, i.first.c_str(), sizeof(relocResult.name) - 1);
+        relocResult.name[sizeof(relocResult.name) - 1] = '\0';
+        AddResult(relocResult);
+    }
+    //printf("-------\n");
+}
+
+void CN64Sym::GetVariantRelocName(CSignatureFile& sigFile, size_t nSymbol, int nVariant, size_t nReloc, char *str, size_t nMaxChars)
+{
+    sigFile.GetRelocName(nSymbol, nReloc, str, nMaxChars);
+
+    if(nVariant == -1)
+    {
+        return;
+    }
+
+    uint32_t relocOffset = sigFile.GetRelocOffset(nSymbol, nReloc);
+
+    for(size_t nAliasReloc = 0; nAliasReloc < sigFile.GetNumAliasRelocs(nSymbol, nVariant); nAliasReloc++)
+    {
+        if(sigFile.GetAliasRelocOffset(nSymbol, nVariant, nAliasReloc) == relocOffset)
         {
-            matchedBlock = block;
-            matchedAddress = blockAddress;
-            bestPartialMatchLength = nBytesMatched;
+            sigFile.GetAliasRelocName(nSymbol, nVariant, nAliasReloc, str, nMaxChars);
+            return;
         }
     }
+}
 
-    m_ThreadPool.LockDefaultMutex();
+int CN64Sym::SelectVariant(CSignatureFile& sigFile, size_t nSymbol, uint32_t offset, std::vector<bool>& conflicts)
+{
+    // symbols with the same body may call functions with different names,
+    // pick the name whose jump targets agree most with the results so far
 
-    Log("%s:%s\n", objProcessingCtx->libraryPath, objProcessingCtx->blockIdentifier);
+    int nBestVariant = -1;
+    int bestScore = 0;
 
-    if(bHaveFullMatch)
+    for(int nVariant = -1; nVariant < (int)sigFile.GetNumAliases(nSymbol); nVariant++)
     {
-        Log("complete match\n");
-        AddSymbolResults(&elf, matchedAddress);
-        AddRelocationResults(&elf, matchedBlock, "__"); // fix me altNamePrefix
+        int score = 0;
+
+        for(size_t nReloc = 0; nReloc < sigFile.GetNumRelocs(nSymbol); nReloc++)
+        {
+            if(sigFile.GetRelocType(nSymbol, nReloc) != R_MIPS_26)
+            {
+                continue;
+            }
+
+            char relocName[128];
+            GetVariantRelocName(sigFile, nSymbol, nVariant, nReloc, relocName, sizeof(relocName));
+
+            uint32_t opcode = bswap32(*(uint32_t*)&m_Binary[offset + sigFile.GetRelocOffset(nSymbol, nReloc)]);
+            uint32_t address = (m_HeaderSize & 0xF0000000) + ((opcode & 0x03FFFFFF) << 2);
+            int check = CheckResultName(address, relocName);
+
+            if(check < 0)
+            {
+                conflicts[nVariant + 1] = true;
+            }
+
+            score += check;
+        }
+
+        if(nVariant == -1 || score > bestScore)
+        {
+            nBestVariant = nVariant;
+            bestScore = score;
+        }
     }
-    else if(bestPartialMatchLength >= 32)
+
+    conflicts[nBestVariant + 1] = false;
+    return nBestVariant;
+}
+
+void CN64Sym::ProcessDataSignatures(CSignatureFile& sigFile)
+{
+    // data objects are only tested at addresses that matched code loads with hi16/lo16,
+    // looked up by the crc of their first bytes
+
+    std::multimap<uint32_t, size_t> crcAIndex; // crcA -> symbol
+    std::set<uint32_t> crcALengths;
+    std::vector<size_t> unindexed; // symbols with relocations in their crcA bytes
+
+    for(size_t nSymbol = 0; nSymbol < sigFile.GetNumSymbols(); nSymbol++)
     {
-        Log("partial match (0x%02X bytes)\n", bestPartialMatchLength);
-        AddSymbolResults(&elf, matchedAddress, bestPartialMatchLength);
-        AddRelocationResults(&elf, matchedBlock, "__", bestPartialMatchLength); // fix me altNamePrefix
+        uint32_t symbolSize = sigFile.GetSymbolSize(nSymbol);
+
+        if(!sigFile.IsDataSymbol(nSymbol) || symbolSize > m_BinarySize)
+        {
+            continue;
+        }
+
+        uint32_t crcALength = std::min<uint32_t>(symbolSize, 8);
+
+        if(sigFile.GetNumRelocs(nSymbol) != 0 && sigFile.GetRelocOffset(nSymbol, 0) < crcALength)
+        {
+            unindexed.push_back(nSymbol);
+            continue;
+        }
+
+        crcAIndex.insert({ sigFile.GetSymbolCrcA(nSymbol), nSymbol });
+        crcALengths.insert(crcALength);
     }
-    else
+
+    if(crcAIndex.size() == 0 && unindexed.size() == 0)
     {
-        m_ThreadPool.UnlockDefaultMutex();
         return;
     }
 
-    for(size_t i = 0; i < textSize; i += 4)
+    std::set<uint32_t> visited;
+
+    // matches may add references of their own
+    for(size_t nRef = 0; nRef < m_DataReferences.size(); nRef++)
     {
-        uint32_t buffOp = bswap32(*(uint32_t*)&matchedBlock[i]);
-        uint32_t textOp = bswap32(*(uint32_t*)&textBuf[i]);
+        uint32_t address = m_DataReferences[nRef];
 
-        CElfRelocation* relocation = NULL;
-        CElfSymbol* symbol = NULL;
-        bool bHaveRel = false;
+        if(address < m_HeaderSize || address - m_HeaderSize >= m_BinarySize ||
+           !visited.insert(address).second)
+        {
+            continue;
+        }
 
-        for(int j = 0; j < elf.NumTextRelocations(); j++)
+        uint32_t offset = address - m_HeaderSize;
+        std::vector<size_t> candidates = unindexed;
+
+        for(auto crcALength : crcALengths)
         {
-            relocation = elf.TextRelocation(j);
-            if(relocation->Offset() == i)
+            if(offset + crcALength > m_BinarySize)
             {
-                Log("have reloc\n");
-                symbol = relocation->Symbol(&elf);
-                bHaveRel = true;
+                break;
+            }
+
+            // crc32() is shadowed by miniz in this file
+            uint32_t crcA = crc32_begin();
+            crc32_read(&m_Binary[offset], crcALength, &crcA);
+            crc32_end(&crcA);
+
+            auto range = crcAIndex.equal_range(crcA);
+
+            for(auto i = range.first; i != range.second; i++)
+            {
+                if(std::min<uint32_t>(sigFile.GetSymbolSize(i->second), 8) == crcALength)
+                {
+                    candidates.push_back(i->second);
+                }
             }
         }
 
-        Log("%08X/%04X: %08X %08X", m_HeaderSize + (matchedAddress + i), i, buffOp, textOp);
-        textOp == buffOp ? Log("\n") : Log(" * %s\n", bHaveRel ? symbol->Name(&elf) : "");
+        for(auto nSymbol : candidates)
+        {
+            if(offset + sigFile.GetSymbolSize(nSymbol) > m_BinarySize ||
+               !IsRangeChanged(offset, sigFile.GetSymbolSize(nSymbol)) || IsSymbolResolved(sigFile, nSymbol))
+            {
+                continue;
+            }
+
+            m_NumCandidateTests++;
+
+            if(!sigFile.TestSymbol(nSymbol, &m_Binary[offset]))
+            {
+                continue;
+            }
+
+            char symbolName[128];
+            sigFile.GetSymbolName(nSymbol, symbolName, sizeof(symbolName));
+            Log("%s: data match at 0x%08X\n", symbolName, address);
+
+            AddSignatureResults(sigFile, nSymbol, offset);
+            break;
+        }
     }
+}
 
-    Log("\n");
-    m_ThreadPool.UnlockDefaultMutex();
+void CN64Sym::TallyNumSymbolsToCheck()
+{
+    m_NumSymbolsToCheck = m_Index->GetNumSymbols();
 }
 
-void* CN64Sym::ProcessObjectProc(void* _objProcessingCtx)
+// results of a session only carry over to scans with the same signatures and options
+uint32_t CN64Sym::GetConfigHash()
 {
-    obj_processing_context_t* objProcessingCtx = (obj_processing_context_t*)_objProcessingCtx;
-    CN64Sym* _this = objProcessingCtx->mt_this;
+    char config[64];
+    int len = snprintf(config, sizeof(config), "%zu %d %d",
+        m_Index->GetNumSymbols(), m_bUseBuiltinSignatures ? 1 : 0, m_bThoroughScan ? 1 : 0);
+
+    uint32_t hash = crc32_begin();
+    crc32_read((const uint8_t *)config, len, &hash);
+
+    if(m_bUseBuiltinSignatures && m_Index->GetBuiltinSignatures() != NULL)
+    {
+        uint32_t builtinCrc = m_Index->GetBuiltinSignatures()->GetCrc();
+        crc32_read((const uint8_t *)&builtinCrc, sizeof(builtinCrc), &hash);
+    }
+
+    // another library with the same number of symbols must not pass for the same one
+    for(size_t nEntry = 0; nEntry < m_Index->GetNumEntries(); nEntry++)
+    {
+        const CSignatureIndex::entry_t *entry = m_Index->GetEntry(nEntry);
+        crc32_read((const uint8_t *)entry->path.c_str(), entry->path.size(), &hash);
+        crc32_read((const uint8_t *)&entry->crc, sizeof(entry->crc), &hash);
+    }
+
+    // known symbols decide which signatures are searched for
+    for(auto& known : m_KnownSymbols)
+    {
+        len = snprintf(config, sizeof(config), "%08X %d ", known.address, known.bData ? 1 : 0);
+        crc32_read((const uint8_t *)config, len, &hash);
+        crc32_read((const uint8_t *)known.name.c_str(), known.name.size(), &hash);
+    }
+
+    crc32_end(&hash);
+    return hash;
+}
+
+void CN64Sym::BeginIncrementalScan()
+{
+    m_bIncremental = false;
+    m_CarriedShadows.clear();
+    m_ShadowedResults.clear();
+
+    // the pages are hashed once, EndSession() adds the results
+    m_Session = CScanSession();
+    m_Session.SetBinary(m_Binary, m_BinarySize, m_HeaderSize);
+    m_Session.SetConfigHash(GetConfigHash());
+
+    if(m_SessionPath != NULL ? !m_PrevSession.Load(m_SessionPath) : !m_bHavePrevSession)
+    {
+        // first scan of the session
+        return;
+    }
+
+    if(!m_Session.IsCompatible(m_PrevSession))
+    {
+        Message("Warning: The session is from another binary or other options, scanning everything\n");
+        return;
+    }
+
+    std::vector<bool> changed;
+    m_Session.GetChangedPages(m_PrevSession, changed);
+
+    m_ChangedPageCounts.assign(1, 0);
+
+    for(bool bChanged : changed)
+    {
+        m_ChangedPageCounts.push_back(m_ChangedPageCounts.back() + (bChanged ? 1 : 0));
+    }
+
+    m_bIncremental = true;
+
+    // results that were derived from unchanged pages still hold
+    for(size_t nResult = 0; nResult < m_PrevSession.GetNumResults(); nResult++)
+    {
+        const CScanSession::result_t& saved = m_PrevSession.GetResult(nResult);
+
+        if(IsRangeChanged(saved.claimOffset, saved.claimSize))
+        {
+            continue;
+        }
+
+        search_result_t result;
+        result.address = saved.address;
+        result.size = saved.size;
+        result.bData = saved.bData;
+        result.bPrimary = saved.bPrimary;
+        result.kind = (n64sym_match_kind_t)saved.kind;
+        result.source = saved.source.c_str();
+        result.claimOffset = saved.claimOffset;
+        result.claimSize = saved.claimSize;
+        strncpy(result.name, saved.name.c_str(), sizeof(result.name) - 1);
+        result.name[sizeof(result.name) - 1] = '\0';
+
+        if(saved.bShadowed)
+        {
+            m_CarriedShadows.push_back(result);
+            continue;
+        }
+
+        m_Results.push_back(result);
+        StreamResult(result);
+
+        if(result.kind == N64SYM_MATCH_COMPLETE || result.kind == N64SYM_MATCH_DATA)
+        {
+            m_MatchedOffsets.insert(result.claimOffset);
+            m_ResolvedNames.insert(saved.name);
+        }
+    }
+
+    for(auto address : m_PrevSession.GetDataReferences())
+    {
+        m_DataReferences.push_back(address);
+    }
+
+    Log("%zu of %zu pages changed, %zu results carried over\n",
+        m_ChangedPageCounts.back(), changed.size(), m_Results.size());
+}
+
+void CN64Sym::AddSessionResult(const search_result_t& result, bool bShadowed)
+{
+    CScanSession::result_t saved;
+    saved.address = result.address;
+    saved.size = result.size;
+    saved.kind = result.kind;
+    saved.bData = result.bData;
+    saved.bPrimary = result.bPrimary && !bShadowed;
+    saved.bShadowed = bShadowed;
+    saved.claimOffset = result.claimOffset;
+    saved.claimSize = result.claimSize;
+    saved.name = result.name;
+    saved.source = result.source != NULL ? result.source : "";
+    m_Session.AddResult(saved);
+}
+
+void CN64Sym::EndSession()
+{
+    // known symbols are read again by every scan
+    for(auto& result : m_Results)
+    {
+        if(result.kind != N64SYM_MATCH_KNOWN)
+        {
+            AddSessionResult(result, false);
+        }
+    }
+
+    for(auto& result : m_ShadowedResults)
+    {
+        AddSessionResult(result, true);
+    }
+
+    std::set<uint32_t> dataReferences(m_DataReferences.begin(), m_DataReferences.end());
+
+    for(auto address : dataReferences)
+    {
+        m_Session.AddDataReference(address);
+    }
+
+    if(m_SessionPath != NULL && !m_Session.Save(m_SessionPath))
+    {
+        Message("Error: Could not write '%s'\n", m_SessionPath);
+    }
+}
+
+// true if any page that overlaps the range changed since the session was saved, or if there's no session
+bool CN64Sym::IsRangeChanged(uint32_t offset, uint32_t size)
+{
+    if(!m_bIncremental)
+    {
+        return true;
+    }
 
-    _this->ProcessObject(objProcessingCtx);
+    size_t numPages = m_ChangedPageCounts.size() - 1;
+    size_t firstPage = offset / SCANSESSION_PAGE_SIZE;
+    size_t endPage = std::min<size_t>(((size_t)offset + std::max<uint32_t>(size, 1) - 1) / SCANSESSION_PAGE_SIZE + 1, numPages);
 
-    delete objProcessingCtx;
+    if(firstPage >= endPage)
+    {
+        return false;
+    }
 
-    return NULL;
+    return m_ChangedPageCounts[endPage] != m_ChangedPageCounts[firstPage];
 }
 
-void CN64Sym::ProcessSignatureFile(const char* path)
+bool CN64Sym::IsSymbolResolved(CSignatureFile& sigFile, size_t nSymbol)
 {
-    CSignatureFile sigFile;
-
-    if(sigFile.Load(path))
+    if(m_ResolvedNames.empty())
     {
-        ProcessSignatureFile(sigFile);
+        return false;
     }
+
+    char symbolName[128];
+    sigFile.GetSymbolName(nSymbol, symbolName, sizeof(symbolName));
+    return m_ResolvedNames.count(symbolName) != 0;
 }
 
-void CN64Sym::ProcessSignatureFile(CSignatureFile& sigFile)
+// true if every global symbol of the object was resolved already
+bool CN64Sym::IsObjectResolved(CElfContext* elf)
 {
-    size_t numSymbols = sigFile.GetNumSymbols();
+    if(m_ResolvedNames.empty())
+    {
+        return false;
+    }
 
-    const char *statusDescription = "(built-in signatures)";
-    int percentDone = 0;
-    int statusLineLen = printf("[  0%%] %s", statusDescription);
+    int numSymbols = elf->NumSymbols();
+    bool bHaveSymbols = false;
 
-    for(size_t nSymbol = 0; nSymbol < numSymbols; nSymbol++)
+    for(int i = 0; i < numSymbols; i++)
     {
-        uint32_t symbolSize = sigFile.GetSymbolSize(nSymbol);
-        uint32_t endOffset = m_BinarySize - symbolSize;
-        char symbolName[128];
-        sigFile.GetSymbolName(nSymbol, symbolName, sizeof(symbolName));
-
-        int percentNow = (int)(((float)nSymbol / numSymbols) * 100);
-        if(percentNow > percentDone)
-        {
-            ClearLine(statusLineLen);
-            statusLineLen = printf("[%3d%%] %s", percentDone, statusDescription);
-            percentDone = percentNow;
-        }
+        CElfSymbol* symbol = elf->Symbol(i);
 
-        for(auto offset : m_LikelyFunctionOffsets)
+        if(symbol->Binding() == STB_GLOBAL &&
+           symbol->Type() != STT_NOTYPE &&
+           symbol->SectionIndex() != SHN_UNDEF &&
+           symbol->Size() > 0)
         {
-            if(TestSignatureSymbol(sigFile, nSymbol, offset))
+            if(m_ResolvedNames.count(symbol->Name(elf)) == 0)
             {
-                goto next_symbol;
+                return false;
             }
-        }
 
-        if(m_bThoroughScan)
-        {
-            for(uint32_t offset = 0; offset < endOffset; offset += 4)
-            {
-                if(TestSignatureSymbol(sigFile, nSymbol, offset))
-                {
-                    goto next_symbol;
-                }
-            }
+            bHaveSymbols = true;
         }
-
-        next_symbol:;
     }
 
-    ClearLine(statusLineLen);
+    return bHaveSymbols;
 }
 
-bool CN64Sym::TestElfObjectText(CElfContext* elf, const char* data, int* nBytesMatched)
+// one line of any output format, false for lines without a symbol (headers, comments)
+bool CN64Sym::ParseKnownSymbol(const char *line, known_symbol_t& known)
 {
-    CElfSection *text_sec, *rel_text_sec;
-    CElfRelocation* text_relocations;
-    const char* text_sec_data;
-    uint32_t text_sec_size;
-    int num_text_relocations;
-
-    text_sec = elf->Section(".text");
+    char name[128];
+    char type[8] = "code";
+    unsigned int address;
 
-    if(text_sec == NULL)
+    while(*line == ' ' || *line == '\t')
     {
-        *nBytesMatched = 0;
-        return false;
+        line++;
     }
 
-    text_sec_data = text_sec->Data(elf);
-    text_sec_size = text_sec->Size();
-    num_text_relocations = elf->NumTextRelocations();
-
-    if(num_text_relocations == 0)
+    if(strncmp(line, ".definelabel", 12) == 0)
     {
-        // no relocations, do plain binary comparison
-        if(memcmp(text_sec_data, data, text_sec_size) == 0)
+        // armips
+        if(sscanf(line, ".definelabel %127[^, \t] , %x", name, &address) != 2)
         {
-            *nBytesMatched = text_sec_size;
-            return true;
+            return false;
         }
-        
-        *nBytesMatched = 0;
-        return false;
     }
-
-    rel_text_sec = elf->Section(".rel.text");
-    text_relocations = (CElfRelocation*) rel_text_sec->Data(elf);
-
-    int cur_reltab_index = 0;
-    
-    for(uint32_t i = 0; i < text_sec_size; i += sizeof(uint32_t))
+    else if(strncmp(line, "- [", 3) == 0)
     {
-        // see if this opcode has a relocation
-
-        CElfRelocation* curRelocation = &text_relocations[cur_reltab_index];
-
-        if(cur_reltab_index < num_text_relocations && i == curRelocation->Offset())
+        // n64split
+        if(sscanf(line, "- [%x , \"%127[^\"]\"", &address, name) != 2)
         {
-            // if for some reason the relocation is on a NOP, don't count it
-            if(data[i] == 0x00000000)
-            {
-                *nBytesMatched = i;
-                return false;
-            }
-
-            // only check the top 6 bits
-            if((text_sec_data[i] & 0xFC) != (data[i] & 0xFC))
-            {
-                *nBytesMatched = i;
-                return false;
-            }
-
-            cur_reltab_index++;
-            continue;
+            return false;
+        }
+    }
+    else if(strncmp(line, "CPU ", 4) == 0)
+    {
+        // nemu
+        if(sscanf(line, "CPU %x: %127s", &address, name) != 2)
+        {
+            return false;
+        }
+    }
+    else if(strchr(line, '=') != NULL)
+    {
+        // splat, which may note the type in a comment
+        if(sscanf(line, "%127[^ \t=] = %x", name, &address) != 2)
+        {
+            return false;
         }
 
-        // fetch the next relocation
-        // this trusts that the object's relocation offsets are in order from least to greatest
-        //for(int j = cur_reltab_index; j < num_text_relocations; j++)
-        //{
-        //    CElfRelocation* cur_relocation = &text_relocations[j];
-        //    cur_relocation_offset = cur_relocation->Offset();
-        //    
-        //    if(cur_relocation_offset < i)
-        //    {
-        //        continue;
-        //    }
-//
-        //    if(cur_relocation_offset == i)
-        //    {
-        //        have_relocation = true;
-        //    }
-        //}
+        if(strstr(line, "type:data") != NULL)
+        {
+            strcpy(type, "data");
+        }
+    }
+    else if(strchr(line, ',') != NULL)
+    {
+        // pj64
+        if(sscanf(line, "%x,%7[^,],%127[^,\r\n]", &address, type, name) != 3)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        // default, the address must be followed by a space so that words like "CPU" aren't read as one
+        int addressLen = 0;
 
-        if(*(uint32_t*)&text_sec_data[i] != *(uint32_t*)&data[i])
+        if(sscanf(line, "%x%n %127s", &address, &addressLen, name) != 2 ||
+           (line[addressLen] != ' ' && line[addressLen] != '\t'))
         {
-            *nBytesMatched = i;
             return false;
         }
     }
+
+    known.address = address;
+    known.bData = (strcmp(type, "data") == 0);
+    known.name = name;
     return true;
 }
 
-bool CN64Sym::TestSignatureSymbol(CSignatureFile& sigFile, size_t nSymbol, uint32_t offset)
+// known symbols take their addresses before the search, and their signatures are skipped
+void CN64Sym::AddKnownResults()
 {
-    typedef struct { uint32_t address; bool haveHi16; bool haveLo16; } test_t;
-    std::map<std::string, test_t> relocMap;
-
-    if(sigFile.TestSymbol(nSymbol, &m_Binary[offset]))
+    if(!m_KnownSymbols.empty())
     {
-        search_result_t result;
-        result.address = m_HeaderSize + offset;
-        result.size = sigFile.GetSymbolSize(nSymbol);
-        sigFile.GetSymbolName(nSymbol, result.name, sizeof(result.name));
-        AddResult(result);
+        Log("%zu known symbols\n", m_KnownSymbols.size());
+    }
 
-        // add results from relocations
-        for(size_t nReloc = 0; nReloc < sigFile.GetNumRelocs(nSymbol); nReloc++)
+    for(auto& known : m_KnownSymbols)
+    {
+        if(known.address == 0)
         {
-            char relocName[128];
-            sigFile.GetRelocName(nSymbol, nReloc, relocName, sizeof(relocName));
-            uint8_t relocType = sigFile.GetRelocType(nSymbol, nReloc);
-            uint32_t relocOffset = sigFile.GetRelocOffset(nSymbol, nReloc);
+            continue;
+        }
 
-            uint32_t opcode = bswap32(*(uint32_t*)&m_Binary[offset + relocOffset]);
+        uint32_t offset = known.address - m_HeaderSize;
+        bool bInBinary = (known.address >= m_HeaderSize && offset < m_BinarySize);
 
-            switch(relocType)
-            {
-            case R_MIPS_HI16:
-                if(relocMap.count(relocName) == 0)
-                {
-                    relocMap[relocName].haveHi16 = true;
-                    relocMap[relocName].haveLo16 = false;
-                }
-                relocMap[relocName].address = (opcode & 0x0000FFFF) << 16;
-                break;
-            case R_MIPS_LO16:
-                if(relocMap.count(relocName) != 0)
-                {
-                    relocMap[relocName].address += (int16_t)(opcode & 0x0000FFFF);
-                }
-                else
-                {
-                    printf("missing hi16?");
-                    exit(0);
-                }
-                break;
-            case R_MIPS_26:
-                relocMap[relocName].address = (m_HeaderSize & 0xF0000000) + ((opcode & 0x03FFFFFF) << 2);
-                break;
-            }
+        search_result_t result;
+        result.address = known.address;
+        result.size = 0;
+        result.bData = known.bData;
+        result.kind = N64SYM_MATCH_KNOWN;
+        result.source = known.source;
+        strncpy(result.name, known.name.c_str(), sizeof(result.name) - 1);
+        result.name[sizeof(result.name) - 1] = '\0';
 
-            //printf("%s %02X %04X\n", relocName, relocType, relocOffset);
+        m_ClaimOffset = bInBinary ? offset : 0;
+        m_ClaimSize = 0;
+
+        // the formats list every name of an address, the later ones are aliases
+        int check = CheckResultName(known.address, result.name);
+
+        if(check == 0)
+        {
+            AddResult(result);
+        }
+        else if(check == -1)
+        {
+            AddAliasResult(result);
         }
 
-        for(auto& i : relocMap)
+        if(bInBinary)
         {
-            search_result_t relocResult;
-            relocResult.address = i.second.address;
-            relocResult.size = 0;
-            strncpy(relocResult.name, i.first.c_str(), sizeof(relocResult.name) - 1);
-            AddResult(relocResult);
+            m_MatchedOffsets.insert(offset);
         }
-        //printf("-------\n");
 
-        return true;
+        m_ResolvedNames.insert(known.name);
     }
-    return false;
 }
 
-void CN64Sym::TallyNumSymbolsToCheck()
+bool CN64Sym::AddResult(search_result_t result)
 {
-    m_NumSymbolsToCheck = 0;
-
-    if(m_bUseBuiltinSignatures)
+    // todo use map
+    if(result.address == 0)
     {
-        m_NumSymbolsToCheck += m_BuiltinSigs.GetNumSymbols();
+        return false;
     }
 
-    for(size_t i = 0; i < m_LibPaths.size(); i++)
+    // aliases always share their address with a primary result, except for ones carried over
+    // from a session whose primary result was not
+    for(auto& otherResult : m_Results)
     {
-        CountSymbolsRecursive(m_LibPaths.at(i));
+        if(otherResult.address == result.address && otherResult.bPrimary)
+        {
+            if(m_bUseSession)
+            {
+                // takes the address in a later scan if the other result doesn't carry over
+                result.bPrimary = false;
+                result.claimOffset = m_ClaimOffset;
+                result.claimSize = m_ClaimSize;
+                m_ShadowedResults.push_back(result);
+            }
+
+            return false; // already have
+        }
     }
+
+    result.bPrimary = true;
+    result.claimOffset = m_ClaimOffset;
+    result.claimSize = m_ClaimSize;
+    m_Results.push_back(result);
+    StreamResult(result);
+    return true;
 }
 
-void CN64Sym::CountSymbolsInFile(const char *path)
+bool CN64Sym::HaveResultNamed(const char* name)
 {
-    if(PathIsSignatureFile(path))
+    for(auto& result : m_Results)
     {
-        CSignatureFile sigFile;
-        if(sigFile.Load(path))
+        if(strcmp(result.name, name) == 0)
         {
-            m_NumSymbolsToCheck += sigFile.GetNumSymbols();
+            return true;
         }
     }
-    else if(PathIsStaticLibrary(path))
+
+    return false;
+}
+
+int CN64Sym::CheckResultName(uint32_t address, const char* name)
+{
+    // 1 if a result at address has this name, -1 if it only has other names, 0 if there is none
+    int check = 0;
+
+    for(auto& result : m_Results)
     {
-        CArReader ar;
-        if(ar.Load(path))
+        if(result.address == address)
         {
-            while(ar.SeekNextBlock())
+            if(strcmp(result.name, name) == 0)
             {
-                if(!PathIsObjectFile(ar.GetBlockIdentifier()))
-                {
-                    continue;
-                }
-
-                CElfContext elf;
-                elf.LoadFromMemory(ar.GetBlockData(), ar.GetBlockSize());
-                m_NumSymbolsToCheck += CountGlobalSymbolsInElf(elf); // probably needs work
+                return 1;
             }
+
+            check = -1;
         }
     }
-    else if(PathIsObjectFile(path))
-    {
-        CElfContext elf;
-        if(elf.Load(path))
-        {
-            m_NumSymbolsToCheck += CountGlobalSymbolsInElf(elf);
-        }
-    }
+
+    return check;
 }
 
-size_t CN64Sym::CountGlobalSymbolsInElf(CElfContext& elf)
+bool CN64Sym::AddAliasResult(search_result_t result)
 {
-    size_t count = 0;
-    int numSymbols = elf.NumSymbols();
-
-    for(int i = 0; i < numSymbols; i++)
+    // unlike AddResult, allows more than one name per address
+    for(auto& otherResult : m_Results)
     {
-        CElfSymbol* symbol = elf.Symbol(i);
-        if(symbol->Binding() == STB_GLOBAL &&
-           symbol->Type() != STT_NOTYPE &&
-           symbol->SectionIndex() != SHN_UNDEF &&
-           symbol->Size() > 0)
+        if(otherResult.address == result.address &&
+           strcmp(otherResult.name, result.name) == 0)
         {
-            count++; // probably needs work
+            return false; // already have
         }
     }
-    return count;
+
+    result.bPrimary = false;
+    result.claimOffset = m_ClaimOffset;
+    result.claimSize = m_ClaimSize;
+    m_Results.push_back(result);
+    StreamResult(result);
+    return true;
 }
 
-void CN64Sym::CountSymbolsRecursive(const char* path)
+void CN64Sym::StreamJsonString(FILE *file, const char *str)
 {
-    if (IsFileWithSymbols(path))
-    {
-        CountSymbolsInFile(path);
-        return;
-    }
-    DIR *dir;
-    dir = opendir(path);
-    if (dir == NULL)
-    {
-        printf("%s is neither a directory or file with symbols.\n", path);
-        return;
-    }
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL)
+    fputc('"', file);
+
+    for(const char *c = str; *c != '\0'; c++)
     {
-        char next_path[PATH_MAX];
-        if (!entry->d_name) continue;
-        snprintf(next_path, sizeof(next_path), "%s/%s", path, entry->d_name);
-        switch (entry->d_type) {
-            case DT_DIR:
-                // skip "." dirs
-                if (entry->d_name[0] == '.')
-                {
-                    continue;
-                }
-                // scan subdirectory
-                ScanRecursive(next_path);
-                break;
-            case DT_REG:
-            {
-                if (IsFileWithSymbols(next_path))
-                {
-                    CountSymbolsInFile(next_path);
-                }
-                break;
-            }
-            default:
-                break;
+        if(*c == '"' || *c == '\\')
+        {
+            fputc('\\', file);
         }
+
+        fputc((*c < 0x20) ? '?' : *c, file);
     }
-    closedir(dir);
+
+    fputc('"', file);
 }
 
-bool CN64Sym::AddResult(search_result_t result)
+// one JSON object per line, written as soon as the result is accepted
+void CN64Sym::StreamResult(const search_result_t& result)
 {
-    // todo use map
-    if(result.address == 0)
-    {
-        return false;
-    }
-
-    for(auto& otherResult : m_Results)
+    if(m_StreamFile == NULL)
     {
-        if(otherResult.address == result.address)
-        {
-            return false; // already have
-        }
+        return;
     }
 
-    m_Results.push_back(result);
-    return true;
+    fprintf(m_StreamFile, "{\"address\":\"0x%08X\",\"name\":", result.address);
+    StreamJsonString(m_StreamFile, result.name);
+    fprintf(m_StreamFile, ",\"size\":%u,\"source\":", result.size);
+    StreamJsonString(m_StreamFile, result.source != NULL ? result.source : "");
+    fprintf(m_StreamFile, ",\"kind\":\"%s\"}\n", MatchKindNames[result.kind]);
+    fflush(m_StreamFile);
 }
 
-void CN64Sym::AddSymbolResults(CElfContext* elf, uint32_t baseAddress, uint32_t maxTextOffset)
+void CN64Sym::AddSymbolResults(CElfContext* elf, const char* source, uint32_t baseAddress, uint32_t maxTextOffset)
 {
     int nSymbols = elf->NumSymbols();
 
@@ -900,6 +2389,9 @@ void CN64Sym::AddSymbolResults(CElfContext* elf, uint32_t baseAddress, uint32_t
             search_result_t result;
             result.address = m_HeaderSize + (baseAddress + symbol->Value());
             result.size = symbol->Size();
+            result.bData = false;
+            result.kind = maxTextOffset > 0 ? N64SYM_MATCH_PARTIAL : N64SYM_MATCH_COMPLETE;
+            result.source = source;
             strcpy(result.name, symbol->Name(elf));
 
             Log("adding %s\n", result.name);
@@ -908,7 +2400,7 @@ void CN64Sym::AddSymbolResults(CElfContext* elf, uint32_t baseAddress, uint32_t
     }
 }
 
-void CN64Sym::AddRelocationResults(CElfContext* elf, const char* block, const char* altNamePrefix, int maxTextOffset)
+void CN64Sym::AddRelocationResults(CElfContext* elf, const char* source, const char* block, const char* altNamePrefix, int maxTextOffset)
 {
     Log("Adding relocation results...\n");
 
@@ -937,7 +2429,11 @@ void CN64Sym::AddRelocationResults(CElfContext* elf, const char* block, const ch
             search_result_t result;
             result.address = jalTarget;
             result.size = 0;
+            result.bData = false;
+            result.kind = N64SYM_MATCH_RELOCATION;
+            result.source = source;
             strncpy(result.name, symbol->Name(elf), sizeof(result.name) - 1);
+            result.name[sizeof(result.name) - 1] = '\0';
 
             if(relocation->SymbolIndex() == 1)
             {
@@ -966,7 +2462,8 @@ void CN64Sym::AddRelocationResults(CElfContext* elf, const char* block, const ch
                 uint32_t upperOp = bswap32(*(uint32_t*)&block[prevRelocation->Offset()]);
                 uint32_t lowerOp = opcode;
 
-                // TODO: Implement
+                uint32_t address = ((upperOp & 0xFFFF) << 16) + (int16_t)(lowerOp & 0xFFFF);
+                m_DataReferences.push_back(address);
 
                 CElfSymbol* symbol = relocation->Symbol(elf);
                 Log("%04X%04X,data,%s\n", upperOp & 0xFFFF, lowerOp & 0xFFFF, symbol->Name(elf));
@@ -977,12 +2474,18 @@ void CN64Sym::AddRelocationResults(CElfContext* elf, const char* block, const ch
 
 bool CN64Sym::ResultCmp(search_result_t a, search_result_t b)
 {
-    return (a.address < b.address);
+    // the primary result first, it may have been found after aliases that were carried over
+    if(a.address != b.address)
+    {
+        return (a.address < b.address);
+    }
+
+    return a.bPrimary && !b.bPrimary;
 }
 
 void CN64Sym::SortResults()
 {
-    std::sort(m_Results.begin(), m_Results.end(), ResultCmp);
+    std::stable_sort(m_Results.begin(), m_Results.end(), ResultCmp);
 }
 
 void CN64Sym::ClearLine(int nChars)
@@ -1001,23 +2504,15 @@ void CN64Sym::Log(const char* format, ...)
 
     va_list args;
     va_start(args, format);
-    vprintf(format, args);
+    vfprintf((m_StreamFile == stdout) ? stderr : stdout, format, args);
     va_end(args);
 }
 
-void CN64Sym::Output(const char *format, ...)
+void CN64Sym::Message(const char* format, ...)
 {
+    // keep stdout to the results when they are streamed there
     va_list args;
     va_start(args, format);
-
-    size_t len = vsnprintf(NULL, 0, format, args);
-    char *str = new char[len + 1];
-    va_end(args);
-
-    va_start(args, format);
-    vsprintf(str, format, args);
+    vfprintf((m_StreamFile == stdout) ? stderr : stdout, format, args);
     va_end(args);
-
-    *m_Output << str;
-    delete[] str;
 }
@@ -12,16 +12,30 @@
 
 #include <stdarg.h>
 #include <stdlib.h>
+#include <stdio.h>
 #include <vector>
 #include <algorithm>
 #include <set>
 #include <fstream>
+#include <string>
 
 #include "arutil.h"
 #include "elfutil.h"
 #include "threadpool.h"
 #include "signaturefile.h"
+#include "sigindex.h"
 #include "pathutil.h"
+#include "bufferedwriter.h"
+#include "scansession.h"
+
+// minimum number of leading bytes that must match to accept a partial match
+#define N64SYM_MIN_PARTIAL_MATCH 32
+
+// byte-swapped ROM images are normalized in chunks aligned to this many bytes (a page)
+#define N64SYM_SWAP_CHUNK_ALIGN 0x1000
+
+// initial size of the buffer for input that can't be mapped, doubled as needed
+#define N64SYM_READ_BUFFER_SIZE 0x100000
 
 typedef enum
 {
@@ -33,21 +47,56 @@ typedef enum
     N64SYM_FMT_SPLAT
 } n64sym_output_fmt_t;
 
+// how a result was found, see -n
+typedef enum
+{
+    N64SYM_MATCH_COMPLETE,   // whole function matched
+    N64SYM_MATCH_PARTIAL,    // leading bytes of a function matched
+    N64SYM_MATCH_DATA,       // data object matched at a referenced address
+    N64SYM_MATCH_RELOCATION, // target of a relocation in a matched symbol
+    N64SYM_MATCH_ALIAS,      // other name of a matched symbol
+    N64SYM_MATCH_KNOWN       // read from a symbol file, see --known
+} n64sym_match_kind_t;
+
 class CN64Sym
 {
 public:
     CN64Sym();
     ~CN64Sym();
     bool LoadBinary(const char *binPath);
+#ifndef WIN32
+    bool LoadBinary(int fd, const char *binName);
+#endif
     void AddLibPath(const char* libPath);
+    bool AddKnownSymbols(const char *path);
     void UseBuiltinSignatures(bool bUseBuiltinSignatures);
     void SetVerbose(bool bVerbose);
     void SetThoroughScan(bool bThorough);
     bool SetOutputFormat(const char *fmtName);
     void SetHeaderSize(uint32_t headerSize);
-    bool SetOutputPath(const char *path);
+    bool AddOutputPath(const char *path);
+    void AddOutputFile(FILE *file);
+    void SetDumpResults(bool bDumpResults);
+    bool SetStreamPath(const char *path);
+    void SetStreamFile(FILE *file);
+    void SetShowProgress(bool bShowProgress);
+    void SetNumThreads(int numThreads);
+    void SetSignatureIndex(CSignatureIndex *index);
+    void SetSessionPath(const char *path);
+    void UseSession(bool bUseSession);
+    void SetPreviousSession(const CScanSession& session);
     bool Run();
     void DumpResults();
+
+    // results of the last Run()
+    size_t GetNumResults();
+    uint32_t GetResultAddress(size_t nResult);
+    const char *GetResultName(size_t nResult);
+    size_t GetNumCandidateTests();
+    uint32_t GetHeaderSize();
+    size_t GetBinarySize();
+    const CScanSession& GetSession(); // if a session is used
+    size_t GetNumChangedPages();
     
 private:
     typedef struct
@@ -57,83 +106,183 @@ private:
     } n64sym_fmt_lut_t;
 
     static n64sym_fmt_lut_t FormatNames[];
+    static const char *MatchKindNames[];
 
     typedef struct
     {
         CN64Sym* mt_this;
         const char* libraryPath;
         const char* blockIdentifier;
-        uint8_t* blockData;
+        const uint8_t* blockData;
         size_t blockSize;
     } obj_processing_context_t;
 
+    // piece of a byte-swapped ROM image, normalized on a worker thread
+    typedef struct
+    {
+        uint8_t* data;
+        size_t size;
+        bool bWordSwapped; // .n64 if set, .v64 otherwise
+    } swap_chunk_t;
+
     typedef struct
     {
         uint32_t address; // from jump target
         uint32_t size; // data match size
         char name[64];
+        bool bData; // matched a data object signature
+        n64sym_match_kind_t kind;
+        const char *source; // file the symbol came from, owned by the signature index
+        bool bPrimary; // added by AddResult(), the other results at its address are aliases
+        uint32_t claimOffset; // range of the binary that the match was made in
+        uint32_t claimSize;
     } search_result_t;
 
+    // entry of a symbol file in one of the output formats
+    typedef struct
+    {
+        uint32_t address;
+        bool bData;
+        std::string name;
+        const char *source; // path of the symbol file
+    } known_symbol_t;
+
     typedef struct
     {
         uint32_t address;
         int nBytesMatched;
+        size_t nSymbol; // signature file symbol index
     } partial_match_t;
 
     CThreadPool m_ThreadPool;
 
     uint8_t* m_Binary;
     size_t   m_BinarySize;
+    bool     m_bBinaryMapped; // m_Binary is a private file mapping rather than a heap buffer
+    size_t   m_LikelyFunctionsEnd; // m_Binary has been searched for likely functions up to here
     uint32_t m_HeaderSize;
 
     bool     m_bVerbose;
     bool     m_bUseBuiltinSignatures;
     bool     m_bThoroughScan;
     bool     m_bOverrideHeaderSize;
+    bool     m_bDumpResults;
+    bool     m_bShowProgress;
     
-    std::ostream *m_Output;
-    std::ofstream m_OutputFile;
+    // every -o, each written in its own format; stdout if there are none
+    typedef struct
+    {
+        n64sym_output_fmt_t format;
+        FILE *file;
+        bool  bOwnFile;    // opened by AddOutputPath()
+    } output_target_t;
+
+    std::vector<output_target_t> m_Outputs;
+    FILE *m_StreamFile;     // NULL unless results are streamed as they are found
+    bool  m_bOwnStreamFile; // m_StreamFile was opened by SetStreamPath()
+    const char *m_CurrentSource; // signature file being scanned
 
-    n64sym_output_fmt_t m_OutputFormat;
+    n64sym_output_fmt_t m_OutputFormat; // last -f, used by the outputs added after it
 
     size_t m_NumSymbolsToCheck;
     size_t m_NumSymbolsChecked;
+    size_t m_NumCandidateTests; // signature tests at a single offset
 
     pthread_mutex_t m_ProgressMutex;
 
     std::vector<search_result_t> m_Results;
     std::vector<const char*> m_LibPaths;
+    std::vector<known_symbol_t> m_KnownSymbols; // added to the results before the search
     std::set<uint32_t> m_LikelyFunctionOffsets;
+    std::vector<uint32_t> m_DataReferences; // addresses loaded by resolved hi16/lo16 pairs
+    std::set<uint32_t> m_MatchedOffsets; // offsets of complete signature matches
 
-    CSignatureFile m_BuiltinSigs;
+    CSignatureIndex  m_OwnIndex; // built from m_LibPaths on the first Run() unless another index is set
+    CSignatureIndex *m_Index;
+    bool             m_bOwnIndexLoaded;
 
-    void ScanRecursive(const char* path);
+    bool         m_bUseSession;
+    const char  *m_SessionPath;  // NULL unless -r is used
+    CScanSession m_Session;      // this scan, written to m_SessionPath when it ends
+    CScanSession m_PrevSession;  // owns the sources of carried over results
+    bool         m_bHavePrevSession;
+    bool         m_bIncremental; // only changed pages are searched
+    std::vector<size_t> m_ChangedPageCounts; // number of changed pages before each page
+    std::set<std::string> m_ResolvedNames;   // symbols that are not searched for again
+    std::vector<search_result_t> m_ShadowedResults; // rejected by AddResult(), saved with the session
+    std::vector<search_result_t> m_CarriedShadows;  // shadowed results of the last session, retried after the search
+    uint32_t     m_ClaimOffset;  // applied to results as they are added
+    uint32_t     m_ClaimSize;
 
-    void ProcessFile(const char* path);
-    void ProcessLibrary(const char* path);
-    void ProcessObject(const char* path);
+    // inflated archive contents are written through this so that byte-swapped ROMs are normalized on the way
+    typedef struct
+    {
+        uint8_t *data;
+        size_t   size;
+        size_t   offset;      // bytes written so far
+        size_t   alignedSize; // size rounded down to whole words, the tail is never swapped
+        uint32_t swapMask;    // byte offsets are xored with this, 3 for .n64 and 1 for .v64 byte order
+        bool     bNormalize;  // contents are a ROM image
+        uint32_t crc;
+    } inflate_output_t;
+
+    void UnloadBinary();
+    bool ProcessBinary(const char *binName);
+    bool LoadArchive(const char *binName);
+    bool InflateGzip(const uint8_t *archive, size_t archiveSize, const char *binName, std::string& contentsName);
+    bool InflateZip(const uint8_t *archive, size_t archiveSize, std::string& contentsName);
+    void BeginInflatedOutput(inflate_output_t& output, size_t size, const char *contentsName);
+    static bool InflateRaw(const uint8_t *src, size_t srcSize, inflate_output_t& output);
+    static bool WriteInflated(inflate_output_t& output, const uint8_t *src, size_t size);
+    bool ProcessRomHeader(const char *binName);
+    static bool DetectRomByteOrder(const uint8_t *header, uint32_t *swapMask);
+    void NormalizeBinary(bool bWordSwapped);
+    void FindLikelyFunctions(size_t end);
+    static void* NormalizeChunkProc(void* _chunk);
+
+    void LoadOwnIndex();
+    void ProcessIndexEntry(const CSignatureIndex::entry_t* entry);
+    void ProcessLibrary(const CSignatureIndex::entry_t* entry);
     void ProcessObject(obj_processing_context_t* objProcessingCtx);
     static void* ProcessObjectProc(void* _objProcessingCtx);
-    void ProcessSignatureFile(const char* path);
     void ProcessSignatureFile(CSignatureFile& sigFile);
+    void ProcessDataSignatures(CSignatureFile& sigFile);
+    static void GetScanOrder(CSignatureFile& sigFile, std::vector<size_t>& order);
 
     bool TestElfObjectText(CElfContext* elf, const char* data, int* nBytesMatched);
-    bool TestSignatureSymbol(CSignatureFile& sigFile, size_t nSymbol, uint32_t offset);
+    bool TestSignatureSymbol(CSignatureFile& sigFile, size_t nSymbol, uint32_t offset, uint32_t* nBytesMatched = NULL, bool bUnclaimedOnly = false);
 
     void TallyNumSymbolsToCheck();
-    void CountSymbolsRecursive(const char *path);
-    void CountSymbolsInFile(const char *path);
-    size_t CountGlobalSymbolsInElf(CElfContext& elf);
+
+    uint32_t GetConfigHash();
+    void BeginIncrementalScan();
+    void AddSessionResult(const search_result_t& result, bool bShadowed);
+    void EndSession();
+    bool IsRangeChanged(uint32_t offset, uint32_t size);
+    bool IsSymbolResolved(CSignatureFile& sigFile, size_t nSymbol);
+    bool IsObjectResolved(CElfContext* elf);
+
+    static bool ParseKnownSymbol(const char *line, known_symbol_t& known);
+    void AddKnownResults();
 
     bool AddResult(search_result_t result);
-    void AddSymbolResults(CElfContext* elf, uint32_t baseAddress, uint32_t maxTextOffset = 0);
-    void AddRelocationResults(CElfContext* elf, const char* block, const char* altNamePrefix, int maxTextOffset = 0);
+    bool AddAliasResult(search_result_t result);
+    bool HaveResultNamed(const char* name);
+    int CheckResultName(uint32_t address, const char* name);
+    void AddSymbolResults(CElfContext* elf, const char* source, uint32_t baseAddress, uint32_t maxTextOffset = 0);
+    void AddRelocationResults(CElfContext* elf, const char* source, const char* block, const char* altNamePrefix, int maxTextOffset = 0);
+    void StreamResult(const search_result_t& result);
+    static void StreamJsonString(FILE *file, const char *str);
+    void AddSignatureResults(CSignatureFile& sigFile, size_t nSymbol, uint32_t offset, uint32_t maxOffset = 0);
+    static void GetVariantRelocName(CSignatureFile& sigFile, size_t nSymbol, int nVariant, size_t nReloc, char *str, size_t nMaxChars);
+    int SelectVariant(CSignatureFile& sigFile, size_t nSymbol, uint32_t offset, std::vector<bool>& conflicts);
     static bool ResultCmp(search_result_t a, search_result_t b);
     void SortResults();
 
     void ProgressInc(size_t numSymbols);
     void Log(const char* format, ...);
-    void Output(const char *format, ...);
+    void Message(const char* format, ...);
+    void DumpResults(CBufferedWriter& out, n64sym_output_fmt_t format);
     static void ClearLine(int nChars);
 };
 
@@ -11,6 +11,258 @@
 #include <stdio.h>
 
 #include "n64sym.h"
+#include "n64symbatch.h"
+#ifndef WIN32
+#include "n64symserver.h"
+#include "n64symwatch.h"
+#endif
+
+static int batch_main(int argc, const char* argv[])
+{
+    CN64SymBatch batch;
+
+    for(int argi = 2; argi < argc; argi++)
+    {
+        if(argv[argi][0] != '-')
+        {
+            batch.AddInputPath(argv[argi]);
+            continue;
+        }
+
+        if(strlen(&argv[argi][1]) != 1)
+        {
+            printf("Error: Invalid switch '%s'\n", argv[argi]);
+            return EXIT_FAILURE;
+        }
+
+        switch(argv[argi][1])
+        {
+        case 'i':
+            if(argi+1 >= argc)
+            {
+                printf("Error: No path specified for '-i'\n");
+                return EXIT_FAILURE;
+            }
+            if(!batch.AddInputList(argv[argi+1]))
+            {
+                printf("Error: Could not open '%s'\n", argv[argi+1]);
+                return EXIT_FAILURE;
+            }
+            argi++;
+            break;
+        case 'l':
+            if(argi+1 >= argc)
+            {
+                printf("Error: No path specified for '-l'\n");
+                return EXIT_FAILURE;
+            }
+            batch.AddLibPath(argv[argi+1]);
+            argi++;
+            break;
+        case 's':
+            batch.UseBuiltinSignatures(true);
+            break;
+        case 't':
+            batch.SetThoroughScan(true);
+            break;
+        case 'v':
+            batch.SetVerbose(true);
+            break;
+        case 'f':
+            if(argi+1 >= argc)
+            {
+                printf("Error: No output format specified for '-f'\n");
+                return EXIT_FAILURE;
+            }
+            if(!batch.SetOutputFormat(argv[argi+1]))
+            {
+                printf("Error: Invalid output format '%s'\n", argv[argi+1]);
+                return EXIT_FAILURE;
+            }
+            argi++;
+            break;
+        case 'h':
+            if(argi+1 >= argc)
+            {
+                printf("Error: No header size specified for '-h'\n");
+                return EXIT_FAILURE;
+            }
+            batch.SetHeaderSize(strtoul(argv[argi+1], NULL, 0));
+            argi++;
+            break;
+        case 'o':
+            if(argi+1 >= argc)
+            {
+                printf("Error: No path specified for '-o'\n");
+                return EXIT_FAILURE;
+            }
+            batch.SetOutputDir(argv[argi+1]);
+            argi++;
+            break;
+        default:
+            printf("Error: Invalid switch '%s'\n", argv[argi]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(!batch.Run())
+    {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int serve_main(int argc, const char* argv[])
+{
+#ifdef WIN32
+    printf("Error: '--serve' is not supported on this platform\n");
+    return EXIT_FAILURE;
+#else
+    CN64SymServer server;
+
+    if(argc < 3)
+    {
+        printf("Error: No socket path specified for '--serve'\n");
+        return EXIT_FAILURE;
+    }
+
+    for(int argi = 3; argi < argc; argi++)
+    {
+        if(argv[argi][0] != '-' || strlen(&argv[argi][1]) != 1)
+        {
+            printf("Error: Unexpected '%s' in command line\n", argv[argi]);
+            return EXIT_FAILURE;
+        }
+
+        switch(argv[argi][1])
+        {
+        case 'l':
+            if(argi+1 >= argc)
+            {
+                printf("Error: No path specified for '-l'\n");
+                return EXIT_FAILURE;
+            }
+            server.AddLibPath(argv[argi+1]);
+            argi++;
+            break;
+        case 's':
+            // the built-in signatures are always loaded, requests choose whether to use them
+            break;
+        case 'v':
+            server.SetVerbose(true);
+            break;
+        default:
+            printf("Error: Invalid switch '%s'\n", argv[argi]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(!server.Run(argv[2]))
+    {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+#endif
+}
+
+static int watch_main(int argc, const char* argv[])
+{
+#ifdef WIN32
+    printf("Error: 'watch' is not supported on this platform\n");
+    return EXIT_FAILURE;
+#else
+    CN64SymWatch watch;
+
+    if(argc < 3)
+    {
+        printf("Error: No path specified for 'watch'\n");
+        return EXIT_FAILURE;
+    }
+
+    for(int argi = 3; argi < argc; argi++)
+    {
+        if(argv[argi][0] != '-' || strlen(&argv[argi][1]) != 1)
+        {
+            printf("Error: Unexpected '%s' in command line\n", argv[argi]);
+            return EXIT_FAILURE;
+        }
+
+        switch(argv[argi][1])
+        {
+        case 'l':
+            if(argi+1 >= argc)
+            {
+                printf("Error: No path specified for '-l'\n");
+                return EXIT_FAILURE;
+            }
+            watch.AddLibPath(argv[argi+1]);
+            argi++;
+            break;
+        case 's':
+            watch.UseBuiltinSignatures(true);
+            break;
+        case 't':
+            watch.SetThoroughScan(true);
+            break;
+        case 'v':
+            watch.SetVerbose(true);
+            break;
+        case 'f':
+            if(argi+1 >= argc)
+            {
+                printf("Error: No output format specified for '-f'\n");
+                return EXIT_FAILURE;
+            }
+            if(!watch.SetOutputFormat(argv[argi+1]))
+            {
+                printf("Error: Invalid output format '%s'\n", argv[argi+1]);
+                return EXIT_FAILURE;
+            }
+            argi++;
+            break;
+        case 'o':
+            if(argi+1 >= argc)
+            {
+                printf("Error: No path specified for '-o'\n");
+                return EXIT_FAILURE;
+            }
+            watch.AddOutputPath(argv[argi+1]);
+            argi++;
+            break;
+        case 'h':
+            if(argi+1 >= argc)
+            {
+                printf("Error: No header size specified for '-h'\n");
+                return EXIT_FAILURE;
+            }
+            watch.SetHeaderSize(strtoul(argv[argi+1], NULL, 0));
+            argi++;
+            break;
+        case 'i':
+            if(argi+1 >= argc || atof(argv[argi+1]) <= 0)
+            {
+                printf("Error: No interval specified for '-i'\n");
+                return EXIT_FAILURE;
+            }
+            watch.SetInterval(atof(argv[argi+1]));
+            argi++;
+            break;
+        default:
+            printf("Error: Invalid switch '%s'\n", argv[argi]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(!watch.Run(argv[2]))
+    {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+#endif
+}
 
 int main(int argc, const char* argv[])
 {
@@ -21,20 +273,47 @@ int main(int argc, const char* argv[])
     {
         printf (
             "n64sym - N64 symbol identification tool (https://github.com/shygoo/n64sym)\n\n"
-            "  Usage: n64sym <binary path> [options]\n\n"
+            "  Usage: n64sym <binary path or - for stdin> [options]\n"
+            "         n64sym batch <binary path(s)/dir(s)> [options]\n"
+            "         n64sym --serve <socket path> [-l <sig/lib/obj path>]\n"
+            "         n64sym watch <binary path> [options]\n\n"
             "  Options:\n"
             "    -s                         scan for symbols from built-in signature file\n"
             "    -l <sig/lib/obj path>      scan for symbols from signature/library/object file(s)\n"
             "    -f <format>                set the output format (pj64, nemu, armips, n64split, splat, default)\n"
-            "    -o <output path>           set the output path\n"
+            "                               may be repeated with -o, each -o uses the last -f before it\n"
+            "    -o <output path>           set the output path, may be repeated to write several files\n"
+            "    -n <stream path>           also write each result as NDJSON as soon as it is found ('-' for stdout)\n"
+            "    -r <session path>          only rescan pages that changed since the last scan with this session\n"
+            "    --known <symbol file>      skip the symbols of a file in any output format, they are kept in the output\n"
             "    -h <headersize>            set the headersize (default: 0x80000000)\n"
             "    -t                         scan thoroughly\n"
-            "    -v                         enable verbose logging\n"
+            "    -v                         enable verbose logging\n\n"
+            "  Batch options:\n"
+            "    -i <list path>             add the binaries listed in a file, one path per line\n"
+            "    -o <output dir>            write <binary name>.sym for each binary and summary.txt to a directory\n\n"
+            "  Watch options:\n"
+            "    -i <seconds>               time between rescans (default: 1)\n"
         );
         
         return EXIT_FAILURE;
     }
 
+    if(strcmp(argv[1], "batch") == 0)
+    {
+        return batch_main(argc, argv);
+    }
+
+    if(strcmp(argv[1], "--serve") == 0)
+    {
+        return serve_main(argc, argv);
+    }
+
+    if(strcmp(argv[1], "watch") == 0)
+    {
+        return watch_main(argc, argv);
+    }
+
     binPath = argv[1];
 
     if(!n64sym.LoadBinary(binPath))
@@ -43,6 +322,26 @@ int main(int argc, const char* argv[])
         return EXIT_FAILURE;
     }
     
+    // read before -o opens its file, which may be the same one
+    for(int argi = 2; argi < argc; argi++)
+    {
+        if(strcmp(argv[argi], "--known") != 0)
+        {
+            continue;
+        }
+        if(argi+1 >= argc)
+        {
+            printf("Error: No path specified for '--known'\n");
+            return EXIT_FAILURE;
+        }
+        if(!n64sym.AddKnownSymbols(argv[argi+1]))
+        {
+            printf("Error: Could not open '%s'\n", argv[argi+1]);
+            return EXIT_FAILURE;
+        }
+        argi++;
+    }
+
     for(int argi = 2; argi < argc; argi++)
     {
         if(argv[argi][0] != '-')
@@ -50,6 +349,12 @@ int main(int argc, const char* argv[])
             printf("Error: Unexpected '%s' in command line\n", argv[argi]);
             return EXIT_FAILURE;
         }
+
+        if(strcmp(argv[argi], "--known") == 0)
+        {
+            argi++;
+            continue;
+        }
         
         if(strlen(&argv[argi][1]) != 1)
         {
@@ -98,13 +403,35 @@ int main(int argc, const char* argv[])
             n64sym.SetHeaderSize(strtoul(argv[argi+1], NULL, 0));
             argi++;
             break;
+        case 'n':
+            if(argi+1 >= argc)
+            {
+                printf("Error: No path specified for '-n'\n");
+                return EXIT_FAILURE;
+            }
+            if(!n64sym.SetStreamPath(argv[argi+1]))
+            {
+                printf("Error: Could not open '%s'\n", argv[argi+1]);
+                return EXIT_FAILURE;
+            }
+            argi++;
+            break;
+        case 'r':
+            if(argi+1 >= argc)
+            {
+                printf("Error: No path specified for '-r'\n");
+                return EXIT_FAILURE;
+            }
+            n64sym.SetSessionPath(argv[argi+1]);
+            argi++;
+            break;
         case 'o':
             if(argi+1 >= argc)
             {
                 printf("Error: No path specified for '-o'\n");
                 return EXIT_FAILURE;
             }
-            if(!n64sym.SetOutputPath(argv[argi+1]))
+            if(!n64sym.AddOutputPath(argv[argi+1]))
             {
                 printf("Error: Could not open '%s'\n", argv[argi+1]);
                 return EXIT_FAILURE;
@@ -0,0 +1,306 @@
+/*
+
+    n64sym batch mode
+    Scans many binaries against one signature index
+    shygoo 2020
+    License: MIT
+
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <climits>
+#include <chrono>
+#include <fstream>
+#include <set>
+
+#include "n64symbatch.h"
+
+#ifdef WIN32
+#include <windirent.h>
+#else
+#include <dirent.h>
+#endif
+
+CN64SymBatch::CN64SymBatch() :
+    m_OutputDir("."),
+    m_FormatName("default"),
+    m_bVerbose(false),
+    m_bUseBuiltinSignatures(false),
+    m_bThoroughScan(false),
+    m_bOverrideHeaderSize(false),
+    m_HeaderSize(0x80000000)
+{
+}
+
+CN64SymBatch::~CN64SymBatch()
+{
+    for(auto job : m_Jobs)
+    {
+        delete job;
+    }
+}
+
+void CN64SymBatch::AddInputPath(const char *path)
+{
+    DIR *dir = opendir(path);
+
+    if(dir != NULL)
+    {
+        closedir(dir);
+        AddInputDirectory(path);
+        return;
+    }
+
+    m_InputPaths.push_back(path);
+}
+
+// every regular file in the directory, not recursive
+void CN64SymBatch::AddInputDirectory(const char *path)
+{
+    DIR *dir = opendir(path);
+
+    if(dir == NULL)
+    {
+        return;
+    }
+
+    struct dirent *entry;
+
+    while((entry = readdir(dir)) != NULL)
+    {
+        if(entry->d_type != DT_REG)
+        {
+            continue;
+        }
+
+        char next_path[PATH_MAX];
+        snprintf(next_path, sizeof(next_path), "%s/%s", path, entry->d_name);
+        m_InputPaths.push_back(next_path);
+    }
+
+    closedir(dir);
+}
+
+// one path per line, blank lines and lines starting with '#' are skipped
+bool CN64SymBatch::AddInputList(const char *path)
+{
+    std::ifstream file;
+    file.open(path);
+
+    if(!file.is_open())
+    {
+        return false;
+    }
+
+    std::string line;
+
+    while(std::getline(file, line))
+    {
+        while(!line.empty() && (line.back() == '\r' || line.back() == ' ' || line.back() == '\t'))
+        {
+            line.pop_back();
+        }
+
+        if(line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        AddInputPath(line.c_str());
+    }
+
+    return true;
+}
+
+void CN64SymBatch::AddLibPath(const char *path)
+{
+    m_LibPaths.push_back(path);
+}
+
+void CN64SymBatch::SetVerbose(bool bVerbose)
+{
+    m_bVerbose = bVerbose;
+}
+
+void CN64SymBatch::UseBuiltinSignatures(bool bUseBuiltinSignatures)
+{
+    m_bUseBuiltinSignatures = bUseBuiltinSignatures;
+}
+
+void CN64SymBatch::SetThoroughScan(bool bThoroughScan)
+{
+    m_bThoroughScan = bThoroughScan;
+}
+
+bool CN64SymBatch::SetOutputFormat(const char *fmtName)
+{
+    CN64Sym n64sym;
+
+    if(!n64sym.SetOutputFormat(fmtName))
+    {
+        return false;
+    }
+
+    m_FormatName = fmtName;
+    return true;
+}
+
+void CN64SymBatch::SetHeaderSize(uint32_t headerSize)
+{
+    m_bOverrideHeaderSize = true;
+    m_HeaderSize = headerSize;
+}
+
+void CN64SymBatch::SetOutputDir(const char *path)
+{
+    m_OutputDir = path;
+}
+
+bool CN64SymBatch::Run()
+{
+    if(m_InputPaths.empty())
+    {
+        printf("Error: No input files\n");
+        return false;
+    }
+
+    // loaded once, read by every job
+    if(m_bUseBuiltinSignatures)
+    {
+        m_Index.LoadBuiltinSignatures();
+    }
+
+    for(auto libPath : m_LibPaths)
+    {
+        m_Index.AddPath(libPath);
+    }
+
+    std::set<std::string> outputPaths;
+
+    for(auto& inputPath : m_InputPaths)
+    {
+        const char *fileName = inputPath.c_str();
+
+        for(const char *p = fileName; *p != '\0'; p++)
+        {
+            if(*p == '/' || *p == '\\')
+            {
+                fileName = p + 1;
+            }
+        }
+
+        std::string outputPath = std::string(m_OutputDir) + "/" + fileName + ".sym";
+
+        // the same binary listed twice, or two binaries with the same name
+        if(outputPaths.count(outputPath) != 0)
+        {
+            printf("Warning: Skipping '%s', '%s' is already an output\n", inputPath.c_str(), outputPath.c_str());
+            continue;
+        }
+
+        outputPaths.insert(outputPath);
+
+        job_t *job = new job_t;
+        job->mt_this = this;
+        job->inputPath = inputPath;
+        job->outputPath = outputPath;
+        job->bLoaded = false;
+        job->numResults = 0;
+        job->seconds = 0;
+        m_Jobs.push_back(job);
+    }
+
+    for(auto job : m_Jobs)
+    {
+        m_ThreadPool.AddWorker(ProcessJobProc, (void *)job);
+    }
+
+    m_ThreadPool.WaitForWorkers();
+
+    return WriteSummary();
+}
+
+void CN64SymBatch::ProcessJob(job_t *job)
+{
+    auto t0 = std::chrono::steady_clock::now();
+
+    // the jobs already occupy every core
+    CN64Sym n64sym;
+    n64sym.SetNumThreads(1);
+    n64sym.SetShowProgress(false);
+    n64sym.SetSignatureIndex(&m_Index);
+    n64sym.SetVerbose(m_bVerbose);
+    n64sym.UseBuiltinSignatures(m_bUseBuiltinSignatures);
+    n64sym.SetThoroughScan(m_bThoroughScan);
+    n64sym.SetOutputFormat(m_FormatName);
+
+    // the header size changes how LoadBinary treats ROM images
+    if(m_bOverrideHeaderSize)
+    {
+        n64sym.SetHeaderSize(m_HeaderSize);
+    }
+
+    if(!n64sym.LoadBinary(job->inputPath.c_str()))
+    {
+        return;
+    }
+
+    if(!n64sym.AddOutputPath(job->outputPath.c_str()) || !n64sym.Run())
+    {
+        return;
+    }
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    job->bLoaded = true;
+    job->numResults = n64sym.GetNumResults();
+    job->seconds = std::chrono::duration<double>(t1 - t0).count();
+}
+
+void *CN64SymBatch::ProcessJobProc(void *_job)
+{
+    job_t *job = (job_t *)_job;
+    job->mt_this->ProcessJob(job);
+    return NULL;
+}
+
+bool CN64SymBatch::WriteSummary()
+{
+    std::string summaryPath = std::string(m_OutputDir) + "/" + N64SYMBATCH_SUMMARY_NAME;
+    FILE *file = fopen(summaryPath.c_str(), "wb");
+
+    if(file == NULL)
+    {
+        printf("Error: Could not open '%s'\n", summaryPath.c_str());
+        return false;
+    }
+
+    size_t numFailed = 0;
+    size_t numResults = 0;
+    double seconds = 0;
+
+    for(auto job : m_Jobs)
+    {
+        if(!job->bLoaded)
+        {
+            fprintf(file, "%s: failed\n", job->inputPath.c_str());
+            printf("%s: failed\n", job->inputPath.c_str());
+            numFailed++;
+            continue;
+        }
+
+        fprintf(file, "%s: %zu symbols (%.3f s) -> %s\n", job->inputPath.c_str(),
+            job->numResults, job->seconds, job->outputPath.c_str());
+        printf("%s: %zu symbols (%.3f s)\n", job->inputPath.c_str(), job->numResults, job->seconds);
+
+        numResults += job->numResults;
+        seconds += job->seconds;
+    }
+
+    fprintf(file, "%zu binaries, %zu failed, %zu symbols, %.3f s\n", m_Jobs.size(), numFailed, numResults, seconds);
+    printf("%zu binaries, %zu failed, %zu symbols, %.3f s\n", m_Jobs.size(), numFailed, numResults, seconds);
+
+    fclose(file);
+    return numFailed == 0;
+}
@@ -0,0 +1,71 @@
+/*
+
+    n64sym batch mode
+    Scans many binaries against one signature index
+    shygoo 2020
+    License: MIT
+
+*/
+
+#ifndef N64SYMBATCH_H
+#define N64SYMBATCH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "n64sym.h"
+#include "sigindex.h"
+#include "threadpool.h"
+
+// summary of the batch, written to the output directory
+#define N64SYMBATCH_SUMMARY_NAME "summary.txt"
+
+class CN64SymBatch
+{
+    typedef struct
+    {
+        CN64SymBatch *mt_this;
+        std::string inputPath;
+        std::string outputPath;
+        bool        bLoaded;
+        size_t      numResults;
+        double      seconds;
+    } job_t;
+
+    CThreadPool m_ThreadPool;
+    CSignatureIndex m_Index;
+    std::vector<std::string> m_InputPaths;
+    std::vector<const char *> m_LibPaths;
+    std::vector<job_t *> m_Jobs; // in input order
+    const char *m_OutputDir;
+    const char *m_FormatName;
+
+    bool     m_bVerbose;
+    bool     m_bUseBuiltinSignatures;
+    bool     m_bThoroughScan;
+    bool     m_bOverrideHeaderSize;
+    uint32_t m_HeaderSize;
+
+    void AddInputDirectory(const char *path);
+    void ProcessJob(job_t *job);
+    static void *ProcessJobProc(void *_job);
+    bool WriteSummary();
+
+public:
+    CN64SymBatch();
+    ~CN64SymBatch();
+
+    void AddInputPath(const char *path);
+    bool AddInputList(const char *path);
+    void AddLibPath(const char *path);
+    void SetVerbose(bool bVerbose);
+    void UseBuiltinSignatures(bool bUseBuiltinSignatures);
+    void SetThoroughScan(bool bThoroughScan);
+    bool SetOutputFormat(const char *fmtName);
+    void SetHeaderSize(uint32_t headerSize);
+    void SetOutputDir(const char *path);
+    bool Run();
+};
+
+#endif // N64SYMBATCH_H
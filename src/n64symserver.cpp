@@ -0,0 +1,443 @@
+/*
+
+    n64sym server mode
+    Answers scan requests over a Unix domain socket with a warm signature index
+    shygoo 2020
+    License: MIT
+
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include <cerrno>
+#include <csignal>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "n64symserver.h"
+
+CN64SymServer::CN64SymServer() :
+    m_bVerbose(false)
+{
+}
+
+void CN64SymServer::AddLibPath(const char *path)
+{
+    m_LibPaths.push_back(path);
+}
+
+void CN64SymServer::SetVerbose(bool bVerbose)
+{
+    m_bVerbose = bVerbose;
+}
+
+bool CN64SymServer::Run(const char *socketPath)
+{
+    struct sockaddr_un address;
+
+    if(strlen(socketPath) >= sizeof(address.sun_path))
+    {
+        printf("Error: Socket path '%s' is too long\n", socketPath);
+        return false;
+    }
+
+    // built-in signatures are always loaded so that requests may use -s
+    m_Index.LoadBuiltinSignatures();
+
+    for(auto libPath : m_LibPaths)
+    {
+        m_Index.AddPath(libPath);
+    }
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if(listenFd < 0)
+    {
+        printf("Error: Could not create socket\n");
+        return false;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketPath);
+
+    // replace the socket of a previous run
+    unlink(socketPath);
+
+    if(bind(listenFd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+       listen(listenFd, N64SYMSERVER_BACKLOG) != 0)
+    {
+        printf("Error: Could not listen on '%s'\n", socketPath);
+        close(listenFd);
+        return false;
+    }
+
+    // streamed results are written with stdio, a client that hangs up must not end the server
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("Listening on '%s' (%zu signatures)\n", socketPath, m_Index.GetNumSymbols());
+    fflush(stdout);
+
+    while(true)
+    {
+        int clientFd = accept(listenFd, NULL, NULL);
+
+        if(clientFd < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            printf("Error: accept failed (%s)\n", strerror(errno));
+            break;
+        }
+
+        // worker thread will delete connection after it's done
+        connection_t *connection = new connection_t;
+        connection->mt_this = this;
+        connection->clientFd = clientFd;
+
+        // blocks while every worker is busy
+        m_ThreadPool.AddWorker(ProcessConnectionProc, (void *)connection);
+    }
+
+    m_ThreadPool.WaitForWorkers();
+    close(listenFd);
+    unlink(socketPath);
+    return false;
+}
+
+// reads one request line, and the file descriptor passed with it if there is one
+bool CN64SymServer::ReadRequest(int clientFd, std::string& line, int *passedFd)
+{
+    *passedFd = -1;
+    line.clear();
+
+    while(line.size() < N64SYMSERVER_MAX_REQUEST)
+    {
+        char buffer[256];
+        char control[CMSG_SPACE(sizeof(int))];
+
+        struct iovec iov;
+        iov.iov_base = buffer;
+        iov.iov_len = sizeof(buffer);
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        ssize_t nBytesRead = recvmsg(clientFd, &msg, 0);
+
+        if(nBytesRead < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if(nBytesRead <= 0)
+        {
+            return false;
+        }
+
+        for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            {
+                int fd;
+                memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+
+                if(*passedFd >= 0)
+                {
+                    close(*passedFd);
+                }
+
+                *passedFd = fd;
+            }
+        }
+
+        for(ssize_t i = 0; i < nBytesRead; i++)
+        {
+            if(buffer[i] == '\n')
+            {
+                return true;
+            }
+
+            if(buffer[i] != '\r')
+            {
+                line += buffer[i];
+            }
+        }
+    }
+
+    return false;
+}
+
+// <binary path> [-f <format>] [-h <headersize>] [-t] [-s] [-n], paths with spaces may be double-quoted
+bool CN64SymServer::ParseRequest(const std::string& line, request_t& request, std::string& error)
+{
+    std::vector<std::string> tokens;
+    size_t pos = 0;
+
+    while(pos < line.size())
+    {
+        if(line[pos] == ' ' || line[pos] == '\t')
+        {
+            pos++;
+            continue;
+        }
+
+        std::string token;
+
+        if(line[pos] == '"')
+        {
+            size_t end = line.find('"', pos + 1);
+
+            if(end == std::string::npos)
+            {
+                error = "Unterminated quote";
+                return false;
+            }
+
+            token = line.substr(pos + 1, end - pos - 1);
+            pos = end + 1;
+        }
+        else
+        {
+            size_t end = line.find_first_of(" \t", pos);
+
+            if(end == std::string::npos)
+            {
+                end = line.size();
+            }
+
+            token = line.substr(pos, end - pos);
+            pos = end;
+        }
+
+        tokens.push_back(token);
+    }
+
+    if(tokens.empty())
+    {
+        error = "No binary specified";
+        return false;
+    }
+
+    request.binPath = tokens[0];
+    request.formatName = "default";
+    request.bOverrideHeaderSize = false;
+    request.headerSize = 0;
+    request.bThoroughScan = false;
+    request.bUseBuiltinSignatures = false;
+    request.bStream = false;
+
+    for(size_t i = 1; i < tokens.size(); i++)
+    {
+        const std::string& token = tokens[i];
+        bool bHaveParam = (i + 1 < tokens.size());
+
+        if(token == "-t")
+        {
+            request.bThoroughScan = true;
+        }
+        else if(token == "-s")
+        {
+            request.bUseBuiltinSignatures = true;
+        }
+        else if(token == "-n")
+        {
+            request.bStream = true;
+        }
+        else if(token == "-f" && bHaveParam)
+        {
+            request.formatName = tokens[++i];
+        }
+        else if(token == "-h" && bHaveParam)
+        {
+            request.bOverrideHeaderSize = true;
+            request.headerSize = strtoul(tokens[++i].c_str(), NULL, 0);
+        }
+        else
+        {
+            error = "Invalid switch '" + token + "'";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool CN64SymServer::SendAll(int fd, const char *data, size_t size)
+{
+    while(size > 0)
+    {
+        ssize_t nBytesSent = send(fd, data, size, MSG_NOSIGNAL);
+
+        if(nBytesSent < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            return false;
+        }
+
+        data += nBytesSent;
+        size -= nBytesSent;
+    }
+
+    return true;
+}
+
+void CN64SymServer::SendError(int fd, const char *format, ...)
+{
+    char message[512];
+    int len = snprintf(message, sizeof(message), "Error: ");
+
+    va_list args;
+    va_start(args, format);
+    len += vsnprintf(&message[len], sizeof(message) - len - 1, format, args);
+    va_end(args);
+
+    if(len > (int)sizeof(message) - 2)
+    {
+        len = sizeof(message) - 2;
+    }
+
+    message[len++] = '\n';
+    SendAll(fd, message, len);
+}
+
+void CN64SymServer::ProcessConnection(int clientFd)
+{
+    std::string line;
+    int passedFd;
+
+    if(!ReadRequest(clientFd, line, &passedFd))
+    {
+        SendError(clientFd, "Incomplete request");
+
+        if(passedFd >= 0)
+        {
+            close(passedFd);
+        }
+
+        return;
+    }
+
+    request_t request;
+    std::string error;
+
+    if(!ParseRequest(line, request, error))
+    {
+        SendError(clientFd, "%s", error.c_str());
+
+        if(passedFd >= 0)
+        {
+            close(passedFd);
+        }
+
+        return;
+    }
+
+    // the request is answered on this worker, the others are busy with other requests
+    CN64Sym n64sym;
+    n64sym.SetNumThreads(1);
+    n64sym.SetShowProgress(false);
+    n64sym.SetSignatureIndex(&m_Index);
+    n64sym.SetVerbose(m_bVerbose);
+    n64sym.UseBuiltinSignatures(request.bUseBuiltinSignatures);
+    n64sym.SetThoroughScan(request.bThoroughScan);
+
+    if(!n64sym.SetOutputFormat(request.formatName.c_str()))
+    {
+        SendError(clientFd, "Invalid output format '%s'", request.formatName.c_str());
+
+        if(passedFd >= 0)
+        {
+            close(passedFd);
+        }
+
+        return;
+    }
+
+    bool bLoaded;
+
+    // the header size changes how LoadBinary treats ROM images
+    if(request.bOverrideHeaderSize)
+    {
+        n64sym.SetHeaderSize(request.headerSize);
+    }
+
+    if(passedFd < 0 && request.binPath == "-")
+    {
+        // would be the server's own stdin
+        SendError(clientFd, "Reading from stdin requires a passed file descriptor");
+        return;
+    }
+
+    if(passedFd >= 0)
+    {
+        bLoaded = n64sym.LoadBinary(passedFd, request.binPath.c_str());
+        close(passedFd);
+    }
+    else
+    {
+        bLoaded = n64sym.LoadBinary(request.binPath.c_str());
+    }
+
+    if(!bLoaded)
+    {
+        SendError(clientFd, "Failed to load '%s'", request.binPath.c_str());
+        return;
+    }
+
+    // results are written to the client through stdio, the socket itself is closed by the caller
+    FILE *clientFile = fdopen(dup(clientFd), "wb");
+
+    if(clientFile == NULL)
+    {
+        SendError(clientFd, "Could not open the connection for writing");
+        return;
+    }
+
+    if(request.bStream)
+    {
+        // results go straight to the client as they are found
+        n64sym.SetStreamFile(clientFile);
+        n64sym.SetDumpResults(false);
+    }
+    else
+    {
+        n64sym.AddOutputFile(clientFile);
+    }
+
+    bool bScanned = n64sym.Run();
+
+    n64sym.SetStreamFile(NULL);
+    fclose(clientFile);
+
+    if(!bScanned)
+    {
+        SendError(clientFd, "Scan failed");
+    }
+}
+
+void *CN64SymServer::ProcessConnectionProc(void *_connection)
+{
+    connection_t *connection = (connection_t *)_connection;
+
+    connection->mt_this->ProcessConnection(connection->clientFd);
+    close(connection->clientFd);
+
+    delete connection;
+    return NULL;
+}
@@ -0,0 +1,66 @@
+/*
+
+    n64sym server mode
+    Answers scan requests over a Unix domain socket with a warm signature index
+    shygoo 2020
+    License: MIT
+
+*/
+
+#ifndef N64SYMSERVER_H
+#define N64SYMSERVER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "n64sym.h"
+#include "sigindex.h"
+#include "threadpool.h"
+
+// maximum length of a request line
+#define N64SYMSERVER_MAX_REQUEST 4096
+
+// pending connections while every worker is busy
+#define N64SYMSERVER_BACKLOG 64
+
+class CN64SymServer
+{
+    typedef struct
+    {
+        CN64SymServer *mt_this;
+        int clientFd;
+    } connection_t;
+
+    typedef struct
+    {
+        std::string binPath; // or the name of the passed file
+        std::string formatName;
+        bool        bOverrideHeaderSize;
+        uint32_t    headerSize;
+        bool        bThoroughScan;
+        bool        bUseBuiltinSignatures;
+        bool        bStream; // send results as NDJSON while scanning instead of the sorted output
+    } request_t;
+
+    CThreadPool m_ThreadPool;
+    CSignatureIndex m_Index;
+    std::vector<const char *> m_LibPaths;
+    bool m_bVerbose;
+
+    static bool ReadRequest(int clientFd, std::string& line, int *passedFd);
+    static bool ParseRequest(const std::string& line, request_t& request, std::string& error);
+    static bool SendAll(int fd, const char *data, size_t size);
+    static void SendError(int fd, const char *format, ...);
+    void ProcessConnection(int clientFd);
+    static void *ProcessConnectionProc(void *_connection);
+
+public:
+    CN64SymServer();
+
+    void AddLibPath(const char *path);
+    void SetVerbose(bool bVerbose);
+    bool Run(const char *socketPath);
+};
+
+#endif // N64SYMSERVER_H
@@ -0,0 +1,312 @@
+/*
+
+    n64sym watch mode
+    Rescans a file that another program keeps changing, such as emulator RAM in /dev/shm
+    shygoo 2020
+    License: MIT
+
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+
+#include <poll.h>
+#include <unistd.h>
+
+#include "n64symwatch.h"
+
+volatile sig_atomic_t CN64SymWatch::m_bRescanRequested = 0;
+
+CN64SymWatch::CN64SymWatch() :
+    m_bHaveSession(false),
+    m_FormatName("default"),
+    m_Interval(N64SYMWATCH_DEFAULT_INTERVAL),
+    m_bStdinOpen(true),
+    m_bVerbose(false),
+    m_bUseBuiltinSignatures(false),
+    m_bThoroughScan(false),
+    m_bOverrideHeaderSize(false),
+    m_HeaderSize(0x80000000)
+{
+}
+
+void CN64SymWatch::AddLibPath(const char *path)
+{
+    m_LibPaths.push_back(path);
+}
+
+void CN64SymWatch::SetVerbose(bool bVerbose)
+{
+    m_bVerbose = bVerbose;
+}
+
+void CN64SymWatch::UseBuiltinSignatures(bool bUseBuiltinSignatures)
+{
+    m_bUseBuiltinSignatures = bUseBuiltinSignatures;
+}
+
+void CN64SymWatch::SetThoroughScan(bool bThoroughScan)
+{
+    m_bThoroughScan = bThoroughScan;
+}
+
+// applies to the outputs added after it, as in a single scan
+bool CN64SymWatch::SetOutputFormat(const char *fmtName)
+{
+    CN64Sym n64sym;
+
+    if(!n64sym.SetOutputFormat(fmtName))
+    {
+        return false;
+    }
+
+    m_FormatName = fmtName;
+    return true;
+}
+
+void CN64SymWatch::AddOutputPath(const char *path)
+{
+    output_t output;
+    output.formatName = m_FormatName;
+    output.path = path;
+    m_Outputs.push_back(output);
+}
+
+void CN64SymWatch::SetHeaderSize(uint32_t headerSize)
+{
+    m_bOverrideHeaderSize = true;
+    m_HeaderSize = headerSize;
+}
+
+void CN64SymWatch::SetInterval(double seconds)
+{
+    m_Interval = seconds;
+}
+
+void CN64SymWatch::RescanSignalHandler(int sig)
+{
+    m_bRescanRequested = 1;
+}
+
+bool CN64SymWatch::Run(const char *binPath)
+{
+    if(m_bUseBuiltinSignatures)
+    {
+        m_Index.LoadBuiltinSignatures();
+    }
+
+    for(auto libPath : m_LibPaths)
+    {
+        m_Index.AddPath(libPath);
+    }
+
+    // no SA_RESTART, the signal has to interrupt the wait
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = RescanSignalHandler;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, NULL);
+
+    printf("Watching '%s' (%zu signatures), press enter or send SIGUSR1 to rescan now, 'q' to quit\n",
+        binPath, m_Index.GetNumSymbols());
+    fflush(stdout);
+
+    for(int nPass = 1; ; nPass++)
+    {
+        // the file may be missing while the emulator restarts, the next pass tries again
+        RunPass(binPath, nPass);
+
+        bool bQuit;
+
+        if(!WaitForNextPass(&bQuit) || bQuit)
+        {
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool CN64SymWatch::RunPass(const char *binPath, int nPass)
+{
+    auto t0 = std::chrono::steady_clock::now();
+
+    CN64Sym n64sym;
+    n64sym.SetShowProgress(false);
+    n64sym.SetSignatureIndex(&m_Index);
+    n64sym.SetVerbose(m_bVerbose);
+    n64sym.UseBuiltinSignatures(m_bUseBuiltinSignatures);
+    n64sym.SetThoroughScan(m_bThoroughScan);
+    n64sym.SetDumpResults(false);
+    n64sym.UseSession(true);
+
+    if(m_bHaveSession)
+    {
+        // only the pages that changed since the last pass are searched
+        n64sym.SetPreviousSession(m_Session);
+    }
+
+    // the header size changes how LoadBinary treats ROM images
+    if(m_bOverrideHeaderSize)
+    {
+        n64sym.SetHeaderSize(m_HeaderSize);
+    }
+
+    if(!n64sym.LoadBinary(binPath))
+    {
+        printf("Error: Failed to load '%s'\n", binPath);
+        fflush(stdout);
+        return false;
+    }
+
+    if(!n64sym.Run())
+    {
+        return false;
+    }
+
+    size_t numChangedPages = n64sym.GetNumChangedPages();
+    bool bFirstPass = !m_bHaveSession;
+
+    m_Session = n64sym.GetSession();
+    m_bHaveSession = true;
+
+    if(numChangedPages == 0 && !bFirstPass)
+    {
+        // the outputs are up to date
+        return true;
+    }
+
+    bool bWritten = WriteOutputs(n64sym);
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    printf("Pass %d: %zu pages changed, %zu symbols (%.3f s)\n", nPass, numChangedPages,
+        n64sym.GetNumResults(), std::chrono::duration<double>(t1 - t0).count());
+    fflush(stdout);
+
+    return bWritten;
+}
+
+// every output is written to a temporary file next to it and renamed over it,
+// so that a reader never sees a partially written file
+bool CN64SymWatch::WriteOutputs(CN64Sym& n64sym)
+{
+    if(m_Outputs.empty())
+    {
+        n64sym.SetOutputFormat(m_FormatName);
+        n64sym.DumpResults();
+        return true;
+    }
+
+    std::vector<FILE *> files;
+    std::vector<std::string> tempPaths;
+    bool bWritten = true;
+
+    for(auto& output : m_Outputs)
+    {
+        std::string tempPath = std::string(output.path) + ".tmp";
+        FILE *file = fopen(tempPath.c_str(), "wb");
+
+        if(file == NULL)
+        {
+            printf("Error: Could not open '%s'\n", tempPath.c_str());
+            bWritten = false;
+            break;
+        }
+
+        n64sym.SetOutputFormat(output.formatName);
+        n64sym.AddOutputFile(file);
+        files.push_back(file);
+        tempPaths.push_back(tempPath);
+    }
+
+    if(bWritten)
+    {
+        n64sym.DumpResults();
+    }
+
+    for(size_t i = 0; i < files.size(); i++)
+    {
+        bool bFileWritten = bWritten && fflush(files[i]) == 0 && !ferror(files[i]) && fsync(fileno(files[i])) == 0;
+        bFileWritten = (fclose(files[i]) == 0) && bFileWritten;
+
+        if(!bFileWritten || rename(tempPaths[i].c_str(), m_Outputs[i].path) != 0)
+        {
+            if(bWritten)
+            {
+                printf("Error: Could not write '%s'\n", m_Outputs[i].path);
+            }
+
+            unlink(tempPaths[i].c_str());
+            bWritten = false;
+        }
+    }
+
+    return bWritten;
+}
+
+// false if waiting failed
+bool CN64SymWatch::WaitForNextPass(bool *bQuit)
+{
+    *bQuit = false;
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(m_Interval);
+
+    while(!m_bRescanRequested)
+    {
+        auto now = std::chrono::steady_clock::now();
+
+        if(now >= deadline)
+        {
+            break;
+        }
+
+        int timeout = (int)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() + 1;
+
+        struct pollfd pfd;
+        pfd.fd = STDIN_FILENO;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        int numReady = poll(&pfd, m_bStdinOpen ? 1 : 0, timeout);
+
+        if(numReady < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            return false;
+        }
+
+        if(numReady == 0)
+        {
+            break;
+        }
+
+        char buffer[256];
+        ssize_t nBytesRead = read(STDIN_FILENO, buffer, sizeof(buffer));
+
+        if(nBytesRead <= 0)
+        {
+            // stdin was closed or isn't readable, keep rescanning on the timer
+            m_bStdinOpen = false;
+            continue;
+        }
+
+        if(buffer[0] == 'q')
+        {
+            *bQuit = true;
+            return true;
+        }
+
+        // any other line asks for a rescan now
+        break;
+    }
+
+    m_bRescanRequested = 0;
+    return true;
+}
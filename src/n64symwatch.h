@@ -0,0 +1,69 @@
+/*
+
+    n64sym watch mode
+    Rescans a file that another program keeps changing, such as emulator RAM in /dev/shm
+    shygoo 2020
+    License: MIT
+
+*/
+
+#ifndef N64SYMWATCH_H
+#define N64SYMWATCH_H
+
+#include <cstdint>
+#include <csignal>
+#include <string>
+#include <vector>
+
+#include "n64sym.h"
+#include "sigindex.h"
+#include "scansession.h"
+
+// seconds between passes unless -i is used
+#define N64SYMWATCH_DEFAULT_INTERVAL 1.0
+
+class CN64SymWatch
+{
+    typedef struct
+    {
+        const char *formatName;
+        const char *path;
+    } output_t;
+
+    CSignatureIndex m_Index;
+    CScanSession m_Session; // of the last pass
+    bool m_bHaveSession;
+    std::vector<const char *> m_LibPaths;
+    std::vector<output_t> m_Outputs;
+    const char *m_FormatName; // last -f, used by the outputs added after it
+    double m_Interval;
+    bool m_bStdinOpen; // rescans can be requested with a line on stdin
+
+    bool     m_bVerbose;
+    bool     m_bUseBuiltinSignatures;
+    bool     m_bThoroughScan;
+    bool     m_bOverrideHeaderSize;
+    uint32_t m_HeaderSize;
+
+    static volatile sig_atomic_t m_bRescanRequested;
+    static void RescanSignalHandler(int sig);
+
+    bool RunPass(const char *binPath, int nPass);
+    bool WriteOutputs(CN64Sym& n64sym);
+    bool WaitForNextPass(bool *bQuit);
+
+public:
+    CN64SymWatch();
+
+    void AddLibPath(const char *path);
+    void SetVerbose(bool bVerbose);
+    void UseBuiltinSignatures(bool bUseBuiltinSignatures);
+    void SetThoroughScan(bool bThoroughScan);
+    bool SetOutputFormat(const char *fmtName);
+    void AddOutputPath(const char *path);
+    void SetHeaderSize(uint32_t headerSize);
+    void SetInterval(double seconds);
+    bool Run(const char *binPath);
+};
+
+#endif // N64SYMWATCH_H
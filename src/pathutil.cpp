@@ -99,6 +99,16 @@ bool PathIsN64Rom(const char *path)
         EndsWith(path, ".V64"));
 }
 
+bool PathIsGzipFile(const char *path)
+{
+    if(strlen(path) < 4)
+    {
+        return false;
+    }
+
+    return EndsWith(path, ".gz") || EndsWith(path, ".GZ");
+}
+
 bool IsFileWithSymbols(const char *path)
 {
     return PathIsStaticLibrary(path) || PathIsObjectFile(path) || PathIsSignatureFile(path);
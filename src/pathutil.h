@@ -5,6 +5,7 @@ bool PathIsStaticLibrary(const char *path);
 bool PathIsObjectFile(const char *path);
 bool PathIsSignatureFile(const char *path);
 bool PathIsN64Rom(const char *path);
+bool PathIsGzipFile(const char *path);
 size_t PathGetFileName(const char *path, char *dstName, size_t maxLength);
 bool IsFileWithSymbols(const char *path);
 
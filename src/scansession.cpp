@@ -0,0 +1,237 @@
+/*
+
+    Scan session for n64sym
+    Page hashes and results of a previous scan, so that a later scan of a similar binary
+    only has to search the pages that changed
+    shygoo 2020
+    License: MIT
+
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+
+#include "scansession.h"
+#include "n64sym.h"
+#include "crc32.h"
+
+CScanSession::CScanSession() :
+    m_BinarySize(0),
+    m_HeaderSize(0),
+    m_ConfigHash(0)
+{
+}
+
+// n64sym-session <version>
+// binary <size> <header size> <config hash>
+// pages <count>, then one crc32 per line
+// refs <count>, then one data reference per line
+// results <count>, then <address> <size> <kind> <data> <primary> <shadowed> <claim offset> <claim size> <name>\t<source>
+bool CScanSession::Load(const char *path)
+{
+    std::ifstream file;
+    file.open(path, std::ifstream::binary);
+
+    if(!file.is_open())
+    {
+        return false;
+    }
+
+    std::string line;
+    char magic[32];
+    int version;
+    unsigned long long binarySize;
+    size_t count;
+
+    m_PageHashes.clear();
+    m_Results.clear();
+    m_DataReferences.clear();
+
+    if(!std::getline(file, line) || sscanf(line.c_str(), "%31s %d", magic, &version) != 2 ||
+       strcmp(magic, SCANSESSION_MAGIC) != 0 || version != SCANSESSION_VERSION)
+    {
+        return false;
+    }
+
+    if(!std::getline(file, line) ||
+       sscanf(line.c_str(), "binary %llu %X %X", &binarySize, &m_HeaderSize, &m_ConfigHash) != 3)
+    {
+        return false;
+    }
+
+    m_BinarySize = binarySize;
+
+    if(!std::getline(file, line) || sscanf(line.c_str(), "pages %zu", &count) != 1)
+    {
+        return false;
+    }
+
+    for(size_t i = 0; i < count; i++)
+    {
+        uint32_t hash;
+
+        if(!std::getline(file, line) || sscanf(line.c_str(), "%X", &hash) != 1)
+        {
+            return false;
+        }
+
+        m_PageHashes.push_back(hash);
+    }
+
+    if(!std::getline(file, line) || sscanf(line.c_str(), "refs %zu", &count) != 1)
+    {
+        return false;
+    }
+
+    for(size_t i = 0; i < count; i++)
+    {
+        uint32_t address;
+
+        if(!std::getline(file, line) || sscanf(line.c_str(), "%X", &address) != 1)
+        {
+            return false;
+        }
+
+        m_DataReferences.push_back(address);
+    }
+
+    if(!std::getline(file, line) || sscanf(line.c_str(), "results %zu", &count) != 1)
+    {
+        return false;
+    }
+
+    for(size_t i = 0; i < count; i++)
+    {
+        result_t result;
+        int bData;
+        int bPrimary;
+        int bShadowed;
+        int nameStart = 0;
+
+        if(!std::getline(file, line) ||
+           sscanf(line.c_str(), "%X %u %d %d %d %d %X %u %n", &result.address, &result.size, &result.kind,
+                  &bData, &bPrimary, &bShadowed, &result.claimOffset, &result.claimSize, &nameStart) != 8 ||
+           nameStart == 0 || result.kind < N64SYM_MATCH_COMPLETE || result.kind > N64SYM_MATCH_KNOWN)
+        {
+            return false;
+        }
+
+        size_t tab = line.find('\t', nameStart);
+
+        if(tab == std::string::npos)
+        {
+            return false;
+        }
+
+        result.bData = (bData != 0);
+        result.bPrimary = (bPrimary != 0);
+        result.bShadowed = (bShadowed != 0);
+        result.name = line.substr(nameStart, tab - nameStart);
+        result.source = line.substr(tab + 1);
+        m_Results.push_back(result);
+    }
+
+    return m_PageHashes.size() == (m_BinarySize + SCANSESSION_PAGE_SIZE - 1) / SCANSESSION_PAGE_SIZE;
+}
+
+bool CScanSession::Save(const char *path)
+{
+    FILE *file = fopen(path, "wb");
+
+    if(file == NULL)
+    {
+        return false;
+    }
+
+    fprintf(file, "%s %d\n", SCANSESSION_MAGIC, SCANSESSION_VERSION);
+    fprintf(file, "binary %llu %08X %08X\n", (unsigned long long)m_BinarySize, m_HeaderSize, m_ConfigHash);
+
+    fprintf(file, "pages %zu\n", m_PageHashes.size());
+
+    for(auto hash : m_PageHashes)
+    {
+        fprintf(file, "%08X\n", hash);
+    }
+
+    fprintf(file, "refs %zu\n", m_DataReferences.size());
+
+    for(auto address : m_DataReferences)
+    {
+        fprintf(file, "%08X\n", address);
+    }
+
+    fprintf(file, "results %zu\n", m_Results.size());
+
+    for(auto& result : m_Results)
+    {
+        fprintf(file, "%08X %u %d %d %d %d %08X %u %s\t%s\n", result.address, result.size, result.kind,
+            result.bData ? 1 : 0, result.bPrimary ? 1 : 0, result.bShadowed ? 1 : 0, result.claimOffset, result.claimSize, result.name.c_str(), result.source.c_str());
+    }
+
+    bool bWritten = (fflush(file) == 0 && !ferror(file));
+    fclose(file);
+    return bWritten;
+}
+
+void CScanSession::SetBinary(const uint8_t *binary, size_t binarySize, uint32_t headerSize)
+{
+    m_BinarySize = binarySize;
+    m_HeaderSize = headerSize;
+    m_PageHashes.clear();
+
+    for(size_t offset = 0; offset < binarySize; offset += SCANSESSION_PAGE_SIZE)
+    {
+        size_t pageSize = std::min<size_t>(SCANSESSION_PAGE_SIZE, binarySize - offset);
+        m_PageHashes.push_back(crc32(&binary[offset], pageSize));
+    }
+}
+
+void CScanSession::SetConfigHash(uint32_t configHash)
+{
+    m_ConfigHash = configHash;
+}
+
+void CScanSession::AddResult(const result_t& result)
+{
+    m_Results.push_back(result);
+}
+
+void CScanSession::AddDataReference(uint32_t address)
+{
+    m_DataReferences.push_back(address);
+}
+
+bool CScanSession::IsCompatible(const CScanSession& other) const
+{
+    return m_BinarySize == other.m_BinarySize &&
+           m_HeaderSize == other.m_HeaderSize &&
+           m_ConfigHash == other.m_ConfigHash &&
+           m_PageHashes.size() == other.m_PageHashes.size();
+}
+
+void CScanSession::GetChangedPages(const CScanSession& other, std::vector<bool>& changed) const
+{
+    changed.resize(m_PageHashes.size());
+
+    for(size_t nPage = 0; nPage < m_PageHashes.size(); nPage++)
+    {
+        changed[nPage] = (m_PageHashes[nPage] != other.m_PageHashes[nPage]);
+    }
+}
+
+size_t CScanSession::GetNumResults() const
+{
+    return m_Results.size();
+}
+
+const CScanSession::result_t& CScanSession::GetResult(size_t nResult) const
+{
+    return m_Results[nResult];
+}
+
+const std::vector<uint32_t>& CScanSession::GetDataReferences() const
+{
+    return m_DataReferences;
+}
@@ -0,0 +1,69 @@
+/*
+
+    Scan session for n64sym
+    Page hashes and results of a previous scan, so that a later scan of a similar binary
+    only has to search the pages that changed
+    shygoo 2020
+    License: MIT
+
+*/
+
+#ifndef SCANSESSION_H
+#define SCANSESSION_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// granularity of change detection
+#define SCANSESSION_PAGE_SIZE 0x1000
+
+#define SCANSESSION_MAGIC "n64sym-session"
+#define SCANSESSION_VERSION 1
+
+class CScanSession
+{
+public:
+    typedef struct
+    {
+        uint32_t    address;
+        uint32_t    size;
+        int         kind;        // n64sym_match_kind_t
+        bool        bData;
+        bool        bPrimary;    // first result at its address, the others are aliases
+        bool        bShadowed;   // lost its address to another result, retried if that one is dropped
+        uint32_t    claimOffset; // range of the binary the result was derived from
+        uint32_t    claimSize;
+        std::string name;
+        std::string source;
+    } result_t;
+
+private:
+    size_t   m_BinarySize;
+    uint32_t m_HeaderSize;
+    uint32_t m_ConfigHash; // signatures and options the results depend on
+    std::vector<uint32_t> m_PageHashes;
+    std::vector<result_t> m_Results;
+    std::vector<uint32_t> m_DataReferences;
+
+public:
+    CScanSession();
+
+    bool Load(const char *path);
+    bool Save(const char *path);
+
+    void SetBinary(const uint8_t *binary, size_t binarySize, uint32_t headerSize);
+    void SetConfigHash(uint32_t configHash);
+    void AddResult(const result_t& result);
+    void AddDataReference(uint32_t address);
+
+    // false if the sessions can't be compared page by page
+    bool IsCompatible(const CScanSession& other) const;
+    void GetChangedPages(const CScanSession& other, std::vector<bool>& changed) const;
+
+    size_t GetNumResults() const;
+    const result_t& GetResult(size_t nResult) const;
+    const std::vector<uint32_t>& GetDataReferences() const;
+};
+
+#endif // SCANSESSION_H
@@ -0,0 +1,265 @@
+/*
+
+    Signature index for n64sym
+    Signature, library and object files loaded once and shared by scans
+    shygoo 2020
+    License: MIT
+
+*/
+
+#include <cstdio>
+#include <fstream>
+#include <climits>
+
+#include <miniz/miniz.h>
+#include <miniz/miniz.c>
+
+#include "sigindex.h"
+#include "builtin_signatures.h"
+#include "arutil.h"
+#include "elfutil.h"
+#include "pathutil.h"
+#include "crc32.h"
+
+#ifdef WIN32
+#include <windirent.h>
+#else
+#include <dirent.h>
+#endif
+
+CSignatureIndex::CSignatureIndex() :
+    m_BuiltinSigs(NULL),
+    m_NumSymbols(0)
+{
+}
+
+CSignatureIndex::~CSignatureIndex()
+{
+    if(m_BuiltinSigs != NULL)
+    {
+        delete m_BuiltinSigs;
+    }
+
+    for(auto entry : m_Entries)
+    {
+        if(entry->sigFile != NULL)
+        {
+            delete entry->sigFile;
+        }
+
+        delete entry;
+    }
+}
+
+bool CSignatureIndex::LoadBuiltinSignatures()
+{
+    if(m_BuiltinSigs != NULL)
+    {
+        return true;
+    }
+
+    char *builtinSigFileContents = new char[gBuiltinSignatureFile.uncSize + 1];
+
+    uLong uncSize = gBuiltinSignatureFile.uncSize;
+    uncompress((uint8_t *)builtinSigFileContents, &uncSize,
+        gBuiltinSignatureFile.data, gBuiltinSignatureFile.cmpSize);
+    builtinSigFileContents[uncSize] = '\0';
+
+    m_BuiltinSigs = new CSignatureFile;
+    bool bLoaded = m_BuiltinSigs->LoadFromMemory(builtinSigFileContents, &m_ThreadPool);
+
+    delete[] builtinSigFileContents;
+
+    m_NumSymbols += m_BuiltinSigs->GetNumSymbols();
+    return bLoaded;
+}
+
+void CSignatureIndex::AddPath(const char *path)
+{
+    ScanRecursive(path);
+}
+
+CSignatureFile *CSignatureIndex::GetBuiltinSignatures()
+{
+    return m_BuiltinSigs;
+}
+
+size_t CSignatureIndex::GetNumEntries()
+{
+    return m_Entries.size();
+}
+
+const CSignatureIndex::entry_t *CSignatureIndex::GetEntry(size_t nEntry)
+{
+    if(nEntry >= m_Entries.size())
+    {
+        return NULL;
+    }
+
+    return m_Entries[nEntry];
+}
+
+size_t CSignatureIndex::GetNumSymbols()
+{
+    return m_NumSymbols;
+}
+
+void CSignatureIndex::ScanRecursive(const char *path)
+{
+    if (IsFileWithSymbols(path))
+    {
+        AddFile(path);
+        return;
+    }
+    DIR *dir;
+    dir = opendir(path);
+    if (dir == NULL)
+    {
+        printf("%s is neither a directory or file with symbols.\n", path);
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        char next_path[PATH_MAX];
+        if (!entry->d_name) continue;
+        snprintf(next_path, sizeof(next_path), "%s/%s", path, entry->d_name);
+        switch (entry->d_type) {
+            case DT_DIR:
+                // skip "." dirs
+                if (entry->d_name[0] == '.')
+                {
+                    continue;
+                }
+                // scan subdirectory
+                ScanRecursive(next_path);
+                break;
+            case DT_REG:
+            {
+                if (IsFileWithSymbols(next_path))
+                {
+                    AddFile(next_path);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    closedir(dir);
+}
+
+void CSignatureIndex::AddFile(const char *path)
+{
+    entry_t *entry = new entry_t;
+    entry->path = path;
+    entry->sigFile = NULL;
+
+    if(PathIsSignatureFile(path))
+    {
+        entry->type = SIGINDEX_SIGNATURE_FILE;
+        entry->sigFile = new CSignatureFile;
+
+        if(!entry->sigFile->Load(path, &m_ThreadPool))
+        {
+            delete entry->sigFile;
+            delete entry;
+            return;
+        }
+
+        m_NumSymbols += entry->sigFile->GetNumSymbols();
+        entry->crc = entry->sigFile->GetCrc();
+    }
+    else if(PathIsStaticLibrary(path))
+    {
+        CArReader ar;
+
+        entry->type = SIGINDEX_LIBRARY;
+
+        if(!ar.Load(path))
+        {
+            delete entry;
+            return;
+        }
+
+        while(ar.SeekNextBlock())
+        {
+            if(!PathIsObjectFile(ar.GetBlockIdentifier()))
+            {
+                continue;
+            }
+
+            object_t object;
+            object.identifier = ar.GetBlockIdentifier();
+            object.data.assign(ar.GetBlockData(), ar.GetBlockData() + ar.GetBlockSize());
+            m_NumSymbols += CountGlobalSymbolsInObject(object);
+            entry->objects.push_back(std::move(object));
+        }
+    }
+    else if(PathIsObjectFile(path))
+    {
+        std::ifstream file;
+        file.open(path, std::ifstream::binary);
+
+        entry->type = SIGINDEX_OBJECT;
+
+        if(!file.is_open())
+        {
+            delete entry;
+            return;
+        }
+
+        file.seekg(0, file.end);
+        size_t size = file.tellg();
+        file.seekg(0, file.beg);
+
+        object_t object;
+        object.identifier = path;
+        object.data.resize(size);
+        file.read((char *)object.data.data(), size);
+        m_NumSymbols += CountGlobalSymbolsInObject(object);
+        entry->objects.push_back(std::move(object));
+    }
+    else
+    {
+        delete entry;
+        return;
+    }
+
+    if(entry->type != SIGINDEX_SIGNATURE_FILE)
+    {
+        entry->crc = crc32_begin();
+
+        for(auto& object : entry->objects)
+        {
+            crc32_read((const uint8_t *)object.identifier.c_str(), object.identifier.size(), &entry->crc);
+            crc32_read(object.data.data(), object.data.size(), &entry->crc);
+        }
+
+        crc32_end(&entry->crc);
+    }
+
+    m_Entries.push_back(entry);
+}
+
+size_t CSignatureIndex::CountGlobalSymbolsInObject(object_t& object)
+{
+    CElfContext elf;
+    elf.LoadFromMemory(object.data.data(), object.data.size());
+
+    size_t count = 0;
+    int numSymbols = elf.NumSymbols();
+
+    for(int i = 0; i < numSymbols; i++)
+    {
+        CElfSymbol* symbol = elf.Symbol(i);
+        if(symbol->Binding() == STB_GLOBAL &&
+           symbol->Type() != STT_NOTYPE &&
+           symbol->SectionIndex() != SHN_UNDEF &&
+           symbol->Size() > 0)
+        {
+            count++; // probably needs work
+        }
+    }
+    return count;
+}
@@ -0,0 +1,68 @@
+/*
+
+    Signature index for n64sym
+    Signature, library and object files loaded once and shared by scans
+    shygoo 2020
+    License: MIT
+
+*/
+
+#ifndef SIGINDEX_H
+#define SIGINDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "signaturefile.h"
+#include "threadpool.h"
+
+typedef enum
+{
+    SIGINDEX_SIGNATURE_FILE,
+    SIGINDEX_LIBRARY,
+    SIGINDEX_OBJECT
+} sigindex_entry_type_t;
+
+class CSignatureIndex
+{
+public:
+    typedef struct
+    {
+        std::string identifier; // member name, or the path of a lone object
+        std::vector<uint8_t> data;
+    } object_t;
+
+    typedef struct
+    {
+        sigindex_entry_type_t type;
+        std::string path;
+        CSignatureFile *sigFile;       // SIGINDEX_SIGNATURE_FILE only
+        std::vector<object_t> objects; // library members, or the object itself
+        uint32_t crc;                  // of the file's contents, see CN64Sym::GetConfigHash()
+    } entry_t;
+
+private:
+    CSignatureFile *m_BuiltinSigs; // NULL until LoadBuiltinSignatures()
+    CThreadPool m_ThreadPool;      // parses the signature files
+    std::vector<entry_t *> m_Entries; // in the order they are scanned
+    size_t m_NumSymbols;
+
+    void ScanRecursive(const char *path);
+    void AddFile(const char *path);
+    static size_t CountGlobalSymbolsInObject(object_t& object);
+
+public:
+    CSignatureIndex();
+    ~CSignatureIndex();
+
+    bool LoadBuiltinSignatures();
+    void AddPath(const char *path);
+
+    CSignatureFile *GetBuiltinSignatures();
+    size_t GetNumEntries();
+    const entry_t *GetEntry(size_t nEntry);
+    size_t GetNumSymbols(); // signatures and global object symbols, including the built-in ones
+};
+
+#endif // SIGINDEX_H
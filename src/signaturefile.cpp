@@ -7,6 +7,7 @@
 */
 
 #include <algorithm>
+#include <cstdarg>
 #include <cstring>
 #include <string>
 #include <vector>
@@ -16,240 +17,484 @@
 
 #include "elfutil.h"
 #include "signaturefile.h"
+#include "threadpool.h"
 #include "crc32.h"
 
 #ifndef min
 #define min(a, b) (((a) < (b)) ? (a) : (b))
 #endif
 
+#ifndef max
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+
+// smallest piece of a signature file that is worth handing to another thread
+#define SIGFILE_MIN_CHUNK_SIZE 0x40000
+
 CSignatureFile::CSignatureFile() :
     m_Buffer(NULL),
     m_Size(0),
-    m_Pos(0)
+    m_Crc(0)
 {
 }
 
 CSignatureFile::~CSignatureFile()
 {
-    for(auto symbol : m_Symbols)
-    {
-        if(symbol.relocs != NULL)
-        {
-            delete symbol.relocs;
-        }
-    }
+    delete[] m_Buffer;
+}
 
+void CSignatureFile::Reset()
+{
     delete[] m_Buffer;
+    m_Buffer = NULL;
+    m_Size = 0;
+    m_Crc = 0;
+
+    m_SymbolNames.clear();
+    m_SymbolSizes.clear();
+    m_SymbolCrcA.clear();
+    m_SymbolCrcB.clear();
+    m_SymbolRelocsStart.clear();
+    m_SymbolAliasesStart.clear();
+    m_SymbolBlockSize.clear();
+    m_SymbolIsData.clear();
+    m_SymbolBlocksStart.clear();
+    m_SymbolPrefixStart.clear();
+    m_SymbolLibraries.clear();
+    m_SymbolCrcAShared.clear();
+    m_SymbolPrefixShared.clear();
+    m_SymbolIsLowEntropy.clear();
+    m_AliasNames.clear();
+    m_AliasRelocsStart.clear();
+    m_AliasRelocOffsets.clear();
+    m_AliasRelocNames.clear();
+    m_BlockCrcs.clear();
+    m_PrefixWords.clear();
+    m_PrefixMasks.clear();
+
+    m_RelocOffsets.clear();
+    m_RelocMasks.clear();
+    m_RelocTypes.clear();
+    m_RelocNames.clear();
+
+    m_ParsedRelocs.clear();
 }
 
 size_t CSignatureFile::GetNumSymbols()
 {
-    return m_Symbols.size();
+    return m_SymbolSizes.size();
+}
+
+uint32_t CSignatureFile::GetCrc()
+{
+    return m_Crc;
 }
 
 uint32_t CSignatureFile::GetSymbolSize(size_t nSymbol)
 {
-    if(nSymbol >= m_Symbols.size())
+    if(nSymbol >= m_SymbolSizes.size())
+    {
+        return 0;
+    }
+
+    return m_SymbolSizes[nSymbol];
+}
+
+uint32_t CSignatureFile::GetSymbolCrcA(size_t nSymbol)
+{
+    if(nSymbol >= m_SymbolCrcA.size())
+    {
+        return 0;
+    }
+
+    return m_SymbolCrcA[nSymbol];
+}
+
+uint32_t CSignatureFile::GetSymbolCrcB(size_t nSymbol)
+{
+    if(nSymbol >= m_SymbolCrcB.size())
     {
         return 0;
     }
 
-    return m_Symbols[nSymbol].size;
+    return m_SymbolCrcB[nSymbol];
 }
 
 bool CSignatureFile::GetSymbolName(size_t nSymbol, char *str, size_t nMaxChars)
 {
-    if(nSymbol >= m_Symbols.size())
+    if(nSymbol >= m_SymbolNames.size())
     {
         return false;
     }
 
-    strncpy(str, m_Symbols[nSymbol].name, nMaxChars);
+    strncpy(str, m_SymbolNames[nSymbol], nMaxChars);
 
     return true;
 }
 
-size_t CSignatureFile::GetNumRelocs(size_t nSymbol)
+size_t CSignatureFile::GetNumAliases(size_t nSymbol)
 {
-    if(nSymbol >= m_Symbols.size() ||
-       m_Symbols[nSymbol].relocs == NULL)
+    if(nSymbol >= m_SymbolSizes.size())
     {
         return 0;
     }
 
-    return m_Symbols[nSymbol].relocs->size();
+    return m_SymbolAliasesStart[nSymbol + 1] - m_SymbolAliasesStart[nSymbol];
 }
 
-uint32_t CSignatureFile::GetRelocOffset(size_t nSymbol, size_t nReloc)
+bool CSignatureFile::GetAliasName(size_t nSymbol, size_t nAlias, char *str, size_t nMaxChars)
+{
+    if(nAlias >= GetNumAliases(nSymbol))
+    {
+        return false;
+    }
+
+    strncpy(str, m_AliasNames[m_SymbolAliasesStart[nSymbol] + nAlias], nMaxChars);
+    return true;
+}
+
+size_t CSignatureFile::GetNumAliasRelocs(size_t nSymbol, size_t nAlias)
 {
-    if(nSymbol >= m_Symbols.size() ||
-       m_Symbols[nSymbol].relocs == NULL ||
-       nReloc >= m_Symbols[nSymbol].relocs->size())
+    if(nAlias >= GetNumAliases(nSymbol))
     {
         return 0;
     }
 
-    reloc_t reloc = m_Symbols[nSymbol].relocs->at(nReloc);
+    size_t nGlobalAlias = m_SymbolAliasesStart[nSymbol] + nAlias;
+    return m_AliasRelocsStart[nGlobalAlias + 1] - m_AliasRelocsStart[nGlobalAlias];
+}
 
-    return reloc.offset;
+uint32_t CSignatureFile::GetAliasRelocOffset(size_t nSymbol, size_t nAlias, size_t nAliasReloc)
+{
+    if(nAliasReloc >= GetNumAliasRelocs(nSymbol, nAlias))
+    {
+        return 0;
+    }
+
+    return m_AliasRelocOffsets[m_AliasRelocsStart[m_SymbolAliasesStart[nSymbol] + nAlias] + nAliasReloc];
 }
 
-uint8_t CSignatureFile::GetRelocType(size_t nSymbol, size_t nReloc)
+bool CSignatureFile::GetAliasRelocName(size_t nSymbol, size_t nAlias, size_t nAliasReloc, char *str, size_t nMaxChars)
 {
-    if(nSymbol >= m_Symbols.size() ||
-       m_Symbols[nSymbol].relocs == NULL ||
-       nReloc >= m_Symbols[nSymbol].relocs->size())
+    if(nAliasReloc >= GetNumAliasRelocs(nSymbol, nAlias))
     {
-        return -1;
+        return false;
+    }
+
+    strncpy(str, m_AliasRelocNames[m_AliasRelocsStart[m_SymbolAliasesStart[nSymbol] + nAlias] + nAliasReloc], nMaxChars);
+    return true;
+}
+
+bool CSignatureFile::HaveAliasRelocs(size_t nSymbol)
+{
+    if(nSymbol >= m_SymbolSizes.size())
+    {
+        return false;
     }
 
-    reloc_t reloc = m_Symbols[nSymbol].relocs->at(nReloc);
+    uint32_t aliasesStart = m_SymbolAliasesStart[nSymbol];
+    uint32_t aliasesEnd = m_SymbolAliasesStart[nSymbol + 1];
 
-    return reloc.type;
+    return m_AliasRelocsStart[aliasesEnd] != m_AliasRelocsStart[aliasesStart];
 }
 
-bool CSignatureFile::GetRelocName(size_t nSymbol, size_t nReloc, char *str, size_t nMaxChars)
+bool CSignatureFile::IsDataSymbol(size_t nSymbol)
 {
-    if(nSymbol >= m_Symbols.size() ||
-       m_Symbols[nSymbol].relocs == NULL ||
-       nReloc >= m_Symbols[nSymbol].relocs->size())
+    if(nSymbol >= m_SymbolIsData.size())
     {
         return false;
     }
 
-    reloc_t reloc = m_Symbols[nSymbol].relocs->at(nReloc);
+    return m_SymbolIsData[nSymbol] != 0;
+}
+
+bool CSignatureFile::GetSymbolLibrary(size_t nSymbol, char *str, size_t nMaxChars)
+{
+    if(nSymbol >= m_SymbolLibraries.size() || m_SymbolLibraries[nSymbol] == NULL)
+    {
+        return false;
+    }
 
-    strncpy(str, reloc.name, nMaxChars);
+    strncpy(str, m_SymbolLibraries[nSymbol], nMaxChars);
     return true;
 }
 
-void CSignatureFile::ReadStrippedWord(uint8_t *dst, const uint8_t *src, int relType)
+uint32_t CSignatureFile::GetSymbolCrcAShared(size_t nSymbol)
 {
-    memcpy(dst, src, 4);
+    if(nSymbol >= m_SymbolCrcAShared.size())
+    {
+        return 0;
+    }
 
-    switch(relType)
+    return m_SymbolCrcAShared[nSymbol];
+}
+
+uint32_t CSignatureFile::GetSymbolPrefixShared(size_t nSymbol)
+{
+    if(nSymbol >= m_SymbolPrefixShared.size())
+    {
+        return 0;
+    }
+
+    return m_SymbolPrefixShared[nSymbol];
+}
+
+bool CSignatureFile::IsLowEntropySymbol(size_t nSymbol)
+{
+    if(nSymbol >= m_SymbolIsLowEntropy.size())
+    {
+        return false;
+    }
+
+    return m_SymbolIsLowEntropy[nSymbol] != 0;
+}
+
+bool CSignatureFile::IsAmbiguousSymbol(size_t nSymbol)
+{
+    // a shared crcA only costs an extra crc, a shared prefix means another
+    // signature may match the same data; symbols without statistics are treated as specific
+    return IsLowEntropySymbol(nSymbol) || GetSymbolPrefixShared(nSymbol) != 0;
+}
+
+uint32_t CSignatureFile::GetBlockSize(size_t nSymbol)
+{
+    if(nSymbol >= m_SymbolBlockSize.size())
     {
-    case 4:
-        // targ26
-        dst[0] &= 0xFC;
-        dst[1] = 0x00;
-        dst[2] = 0x00;
-        dst[3] = 0x00;
-        break;
-    case 5:
-    case 6:
-        // hi/lo16
-        dst[2] = 0x00;
-        dst[3] = 0x00;
-        break;
+        return 0;
     }
+
+    return m_SymbolBlockSize[nSymbol];
 }
 
-//void debug(const uint8_t *buf, size_t size)
-//{
-//    printf("\n");
-//    for(size_t i = 0; i < size; i++)
-//    {
-//        printf("%02X ", buf[i]);
-//    }
-//}
+size_t CSignatureFile::GetNumBlocks(size_t nSymbol)
+{
+    if(nSymbol >= m_SymbolSizes.size())
+    {
+        return 0;
+    }
+
+    return m_SymbolBlocksStart[nSymbol + 1] - m_SymbolBlocksStart[nSymbol];
+}
 
-bool CSignatureFile::TestSymbol(size_t nSymbol, const uint8_t *buffer)
+uint32_t CSignatureFile::GetBlockCrc(size_t nSymbol, size_t nBlock)
 {
-    if(nSymbol >= m_Symbols.size())
+    if(nBlock >= GetNumBlocks(nSymbol))
     {
         return 0;
     }
 
-    symbol_info_t& symbol = m_Symbols[nSymbol];
+    return m_BlockCrcs[m_SymbolBlocksStart[nSymbol] + nBlock];
+}
 
-    uint32_t crcA = crc32_begin();
-    uint32_t crcB = crc32_begin();
-    
-    if(symbol.relocs == NULL)
+size_t CSignatureFile::GetNumRelocs(size_t nSymbol)
+{
+    if(nSymbol >= m_SymbolSizes.size())
     {
-        crc32_read(buffer, min(symbol.size, 8), &crcA);
-        crc32_end(&crcA);
+        return 0;
+    }
 
-        if(symbol.crcA != crcA)
-        {
-            return false;
-        }
+    return m_SymbolRelocsStart[nSymbol + 1] - m_SymbolRelocsStart[nSymbol];
+}
+
+uint32_t CSignatureFile::GetRelocOffset(size_t nSymbol, size_t nReloc)
+{
+    if(nReloc >= GetNumRelocs(nSymbol))
+    {
+        return 0;
+    }
 
-        crc32_read(buffer, symbol.size, &crcB);
-        crc32_end(&crcB);
+    return m_RelocOffsets[m_SymbolRelocsStart[nSymbol] + nReloc];
+}
 
-        return (symbol.crcB == crcB);
+uint8_t CSignatureFile::GetRelocType(size_t nSymbol, size_t nReloc)
+{
+    if(nReloc >= GetNumRelocs(nSymbol))
+    {
+        return -1;
     }
 
-    size_t offset = 0;
+    return m_RelocTypes[m_SymbolRelocsStart[nSymbol] + nReloc];
+}
+
+bool CSignatureFile::GetRelocName(size_t nSymbol, size_t nReloc, char *str, size_t nMaxChars)
+{
+    if(nReloc >= GetNumRelocs(nSymbol))
+    {
+        return false;
+    }
 
-    auto reloc = symbol.relocs->begin();
-    uint32_t crcA_limit = min(symbol.size, 8);
+    strncpy(str, m_RelocNames[m_SymbolRelocsStart[nSymbol] + nReloc], nMaxChars);
+    return true;
+}
+
+uint32_t CSignatureFile::GetRelocationMask(int relType)
+{
+    // masks are stored in buffer (big endian) byte order so they can be
+    // applied directly to words read from the binary
+    switch(relType)
+    {
+    case R_MIPS_26:
+        return bswap32(0xFC000000);
+    case R_MIPS_HI16:
+    case R_MIPS_LO16:
+    case R_MIPS_GPREL16:
+        return bswap32(0xFFFF0000);
+    case R_MIPS_32:
+        return 0x00000000;
+    }
+
+    return 0xFFFFFFFF;
+}
+
+void CSignatureFile::CrcRead(const uint8_t *bytes, size_t length, uint32_t *crc, uint32_t *crc2)
+{
+    if(crc2 != NULL)
+    {
+        crc32_read2(bytes, length, crc, crc2);
+    }
+    else
+    {
+        crc32_read(bytes, length, crc);
+    }
+}
 
-    while(offset < crcA_limit && reloc != symbol.relocs->end())
+// crc2 is updated with the same bytes if it is set
+void CSignatureFile::CrcReadMasked(const uint8_t *buffer, uint32_t offset, uint32_t end,
+    const uint32_t *relOffsets, const uint32_t *relMasks, size_t numRelocs, size_t *nReloc, uint32_t *crc, uint32_t *crc2)
+{
+    while(*nReloc < numRelocs && relOffsets[*nReloc] < end)
     {
-        if(offset < reloc->offset)
+        uint32_t relOffset = relOffsets[*nReloc];
+
+        if(offset < relOffset)
         {
-            // read up to relocated op or crcA_limit
-            crc32_read(&buffer[offset], min(reloc->offset, crcA_limit) - offset, &crcA);
-            crc32_read(&buffer[offset], min(reloc->offset, crcA_limit) - offset, &crcB);
-            offset = min(reloc->offset, crcA_limit);
+            // read up to relocated op
+            CrcRead(&buffer[offset], relOffset - offset, crc, crc2);
+            offset = relOffset;
         }
-        else if(offset == reloc->offset) 
+        
+        if(offset == relOffset)
         {
-            // strip and read relocated op
-            uint8_t op[4];
-            ReadStrippedWord(op, &buffer[offset], reloc->type);
-            crc32_read(op, 4, &crcA);
-            crc32_read(op, 4, &crcB);
-            offset += 4;
-            reloc++;
+            // read relocated op with the relocation's field masked out
+            uint32_t op;
+            memcpy(&op, &buffer[offset], sizeof(op));
+            op &= relMasks[*nReloc];
+            CrcRead((const uint8_t *)&op, sizeof(op), crc, crc2);
+            offset += sizeof(op);
         }
+
+        (*nReloc)++;
+    }
+
+    if(offset < end)
+    {
+        CrcRead(&buffer[offset], end - offset, crc, crc2);
     }
+}
 
-    if(offset < crcA_limit)
+size_t CSignatureFile::GetNumPrefixWords(size_t nSymbol)
+{
+    if(nSymbol >= m_SymbolSizes.size())
     {
-        crc32_read(&buffer[offset], crcA_limit - offset, &crcA);
-        crc32_read(&buffer[offset], crcA_limit - offset, &crcB);
-        offset = crcA_limit;
+        return 0;
     }
 
-    crc32_end(&crcA);
+    return m_SymbolPrefixStart[nSymbol + 1] - m_SymbolPrefixStart[nSymbol];
+}
 
-    if(symbol.crcA != crcA)
+uint32_t CSignatureFile::GetPrefixWord(size_t nSymbol, size_t nWord)
+{
+    if(nWord >= GetNumPrefixWords(nSymbol))
+    {
+        return 0;
+    }
+
+    return bswap32(m_PrefixWords[m_SymbolPrefixStart[nSymbol] + nWord]);
+}
+
+bool CSignatureFile::TestSymbol(size_t nSymbol, const uint8_t *buffer, uint32_t *nBytesMatched)
+{
+    if(nBytesMatched != NULL)
+    {
+        *nBytesMatched = 0;
+    }
+
+    if(nSymbol >= m_SymbolSizes.size())
     {
         return false;
     }
 
-    while(offset < symbol.size && reloc != symbol.relocs->end())
+    // compare the masked leading words before doing any crc work
+    uint32_t prefixStart = m_SymbolPrefixStart[nSymbol];
+    uint32_t prefixEnd = m_SymbolPrefixStart[nSymbol + 1];
+
+    for(uint32_t nWord = prefixStart; nWord < prefixEnd; nWord++)
     {
-        if(offset < reloc->offset)
+        uint32_t word;
+        memcpy(&word, &buffer[(nWord - prefixStart) * 4], sizeof(word));
+
+        if((word & m_PrefixMasks[nWord]) != m_PrefixWords[nWord])
         {
-            // read up to relocated op
-            crc32_read(&buffer[offset], reloc->offset - offset, &crcB);
-            offset = reloc->offset;
+            return false;
         }
-        else if(offset == reloc->offset) 
+    }
+
+    uint32_t size = m_SymbolSizes[nSymbol];
+    uint32_t crcA_limit = min(size, 8);
+    uint32_t relStart = m_SymbolRelocsStart[nSymbol];
+    size_t numRelocs = m_SymbolRelocsStart[nSymbol + 1] - relStart;
+    const uint32_t *relOffsets = m_RelocOffsets.data() + relStart;
+    const uint32_t *relMasks = m_RelocMasks.data() + relStart;
+    size_t nReloc = 0;
+
+    // crcB shares its first crcA_limit bytes with crcA
+    uint32_t crc = crc32_begin();
+    CrcReadMasked(buffer, 0, crcA_limit, relOffsets, relMasks, numRelocs, &nReloc, &crc);
+
+    uint32_t crcA = crc;
+    crc32_end(&crcA);
+
+    if(m_SymbolCrcA[nSymbol] != crcA)
+    {
+        return false;
+    }
+
+    uint32_t blockSize = m_SymbolBlockSize[nSymbol];
+
+    if(blockSize != 0)
+    {
+        // reject at the first mismatching block, crcB is read along with the blocks
+        const uint32_t *blockCrcs = m_BlockCrcs.data() + m_SymbolBlocksStart[nSymbol];
+        size_t nBlockReloc = 0;
+
+        for(uint32_t blockOffset = 0; blockOffset < size; blockOffset += blockSize)
         {
-            // strip and read relocated op
-            uint8_t op[4];
-            ReadStrippedWord(op, &buffer[offset], reloc->type);
-            crc32_read(op, sizeof(op), &crcB);
-            offset += 4;
-            reloc++;
+            uint32_t blockEnd = min(blockOffset + blockSize, size);
+            uint32_t sharedEnd = max(blockOffset, min(crcA_limit, blockEnd)); // already in crc
+            uint32_t blockCrc = crc32_begin();
+            CrcReadMasked(buffer, blockOffset, sharedEnd, relOffsets, relMasks, numRelocs, &nBlockReloc, &blockCrc);
+            CrcReadMasked(buffer, sharedEnd, blockEnd, relOffsets, relMasks, numRelocs, &nBlockReloc, &blockCrc, &crc);
+            crc32_end(&blockCrc);
+
+            if(*blockCrcs++ != blockCrc)
+            {
+                return false;
+            }
+
+            if(nBytesMatched != NULL)
+            {
+                *nBytesMatched = blockEnd;
+            }
         }
     }
-
-    if(offset < symbol.size)
+    else
     {
-        crc32_read(&buffer[offset], symbol.size - offset, &crcB);
-        offset = symbol.size;
+        CrcReadMasked(buffer, crcA_limit, size, relOffsets, relMasks, numRelocs, &nReloc, &crc);
     }
 
-    crc32_end(&crcB);
+    crc32_end(&crc);
 
-    return (symbol.crcB == crcB);
+    return (m_SymbolCrcB[nSymbol] == crc);
 }
 
 bool CSignatureFile::RelocOffsetCompare(const reloc_t& a, const reloc_t& b)
@@ -257,15 +502,59 @@ bool CSignatureFile::RelocOffsetCompare(const reloc_t& a, const reloc_t& b)
     return a.offset < b.offset;
 }
 
-void CSignatureFile::SortRelocationsByOffset()
+void CSignatureFile::BuildRelocationTables()
 {
-    for(auto symbol : m_Symbols)
+    size_t numRelocs = m_ParsedRelocs.size();
+
+    m_SymbolRelocsStart.push_back(numRelocs);
+    m_SymbolAliasesStart.push_back(m_AliasNames.size());
+    m_AliasRelocsStart.push_back(m_AliasRelocOffsets.size());
+    m_SymbolBlocksStart.push_back(m_BlockCrcs.size());
+    m_SymbolPrefixStart.push_back(m_PrefixWords.size());
+
+    m_RelocOffsets.reserve(numRelocs);
+    m_RelocMasks.reserve(numRelocs);
+    m_RelocTypes.reserve(numRelocs);
+    m_RelocNames.reserve(numRelocs);
+
+    for(auto& reloc : m_ParsedRelocs)
+    {
+        m_RelocOffsets.push_back(reloc.offset);
+        m_RelocMasks.push_back(GetRelocationMask(reloc.type));
+        m_RelocTypes.push_back(reloc.type);
+        m_RelocNames.push_back(reloc.name);
+    }
+
+    std::vector<reloc_t>().swap(m_ParsedRelocs);
+
+    // mask out the relocated fields of the prefix words
+    m_PrefixMasks.assign(m_PrefixWords.size(), 0xFFFFFFFF);
+
+    for(size_t nSymbol = 0; nSymbol < m_SymbolSizes.size(); nSymbol++)
     {
-        if(symbol.relocs != NULL)
+        uint32_t prefixStart = m_SymbolPrefixStart[nSymbol];
+        uint32_t prefixLimit = (m_SymbolPrefixStart[nSymbol + 1] - prefixStart) * 4;
+
+        for(uint32_t nReloc = m_SymbolRelocsStart[nSymbol]; nReloc < m_SymbolRelocsStart[nSymbol + 1]; nReloc++)
         {
-            std::sort(symbol.relocs->begin(), symbol.relocs->end(), RelocOffsetCompare);
+            uint32_t offset = m_RelocOffsets[nReloc];
+
+            if(offset >= prefixLimit)
+            {
+                break;
+            }
+
+            if(offset % 4 == 0)
+            {
+                m_PrefixMasks[prefixStart + offset / 4] &= m_RelocMasks[nReloc];
+            }
         }
     }
+
+    for(size_t nWord = 0; nWord < m_PrefixWords.size(); nWord++)
+    {
+        m_PrefixWords[nWord] &= m_PrefixMasks[nWord];
+    }
 }
 
 int CSignatureFile::GetRelocationDirectiveValue(const char *str)
@@ -273,37 +562,30 @@ int CSignatureFile::GetRelocationDirectiveValue(const char *str)
     if(strcmp(".targ26", str) == 0) return R_MIPS_26;
     if(strcmp(".hi16", str) == 0) return R_MIPS_HI16;
     if(strcmp(".lo16", str) == 0) return R_MIPS_LO16;
+    if(strcmp(".abs32", str) == 0) return R_MIPS_32;
+    if(strcmp(".gprel16", str) == 0) return R_MIPS_GPREL16;
     return -1;
 }
 
-bool CSignatureFile::LoadFromMemory(const char *contents)
+bool CSignatureFile::LoadFromMemory(const char *contents, CThreadPool *threadPool)
 {
-    if(m_Buffer != NULL)
-    {
-        delete[] m_Buffer;
-        m_Buffer = NULL;
-        m_Size = 0;
-    }
+    Reset();
 
     m_Size = strlen(contents);
     m_Buffer = new char[m_Size + 1];
     memcpy(m_Buffer, contents, m_Size);
     m_Buffer[m_Size] = '\0';
+    m_Crc = crc32((const uint8_t *)m_Buffer, m_Size);
 
-    Parse();
-    SortRelocationsByOffset();
+    Parse(threadPool);
+    BuildRelocationTables();
 
     return true;
 }
 
-bool CSignatureFile::Load(const char *path)
+bool CSignatureFile::Load(const char *path, CThreadPool *threadPool)
 {
-    if(m_Buffer != NULL)
-    {
-        delete[] m_Buffer;
-        m_Buffer = NULL;
-        m_Size = 0;
-    }
+    Reset();
 
     std::ifstream file;
     file.open(path, std::ifstream::binary);
@@ -316,45 +598,417 @@ bool CSignatureFile::Load(const char *path)
     file.seekg(0, file.end);
     m_Size = file.tellg();
     file.seekg(0, file.beg);
-    m_Buffer = new char[m_Size];
+    m_Buffer = new char[m_Size + 1];
     file.read(m_Buffer, m_Size);
+    m_Buffer[m_Size] = '\0';
+    m_Crc = crc32((const uint8_t *)m_Buffer, m_Size);
 
-    Parse();
-    SortRelocationsByOffset();
+    Parse(threadPool);
+    BuildRelocationTables();
 
     return true;
 }
 
-void CSignatureFile::Parse()
+// threadPool must have no running workers
+void CSignatureFile::Parse(CThreadPool *threadPool)
+{
+    // split the buffer into chunks at blank lines that precede a symbol
+    // definition so that each chunk can be tokenized independently
+
+    CThreadPool *ownThreadPool = NULL;
+
+    if(threadPool == NULL)
+    {
+        ownThreadPool = new CThreadPool;
+        threadPool = ownThreadPool;
+    }
+
+    std::vector<parse_chunk_t *> chunks;
+
+    size_t maxChunks = threadPool->GetNumCPUCores();
+    size_t chunkSize = std::max<size_t>(m_Size / maxChunks, SIGFILE_MIN_CHUNK_SIZE);
+    size_t chunkStart = 0;
+    int chunkLine = 1;
+
+    while(chunkStart < m_Size)
+    {
+        size_t chunkEnd = m_Size;
+
+        if(m_Size - chunkStart > chunkSize)
+        {
+            chunkEnd = FindChunkBoundary(chunkStart + chunkSize);
+        }
+
+        parse_chunk_t *chunk = new parse_chunk_t;
+        chunk->buffer = &m_Buffer[chunkStart];
+        chunk->size = chunkEnd - chunkStart;
+        chunk->pos = 0;
+        chunk->line = chunkLine;
+        chunk->tokenLine = chunkLine;
+        chunk->bErrored = false;
+        chunks.push_back(chunk);
+
+        chunkLine += std::count(chunk->buffer, chunk->buffer + chunk->size, '\n');
+        chunkStart = chunkEnd;
+    }
+
+    if(chunks.size() == 1)
+    {
+        ParseChunk(chunks[0]);
+    }
+    else
+    {
+        for(auto chunk : chunks)
+        {
+            threadPool->AddWorker(ParseChunkProc, (void *)chunk);
+        }
+
+        threadPool->WaitForWorkers();
+    }
+
+    delete ownThreadPool;
+
+    // concatenate the chunk tables in file order, stopping at the first error
+
+    bool bErrored = false;
+
+    for(auto chunk : chunks)
+    {
+        if(!bErrored)
+        {
+            size_t relocBase = m_ParsedRelocs.size();
+            size_t aliasBase = m_AliasNames.size();
+            size_t blockBase = m_BlockCrcs.size();
+            size_t prefixBase = m_PrefixWords.size();
+
+            for(auto& symbol : chunk->symbols)
+            {
+                m_SymbolNames.push_back(symbol.name);
+                m_SymbolSizes.push_back(symbol.size);
+                m_SymbolCrcA.push_back(symbol.crcA);
+                m_SymbolCrcB.push_back(symbol.crcB);
+                m_SymbolRelocsStart.push_back(relocBase + symbol.relocsStart);
+                m_SymbolAliasesStart.push_back(aliasBase + symbol.aliasesStart);
+                m_SymbolBlockSize.push_back(symbol.blockSize);
+                m_SymbolIsData.push_back(symbol.bData);
+                m_SymbolBlocksStart.push_back(blockBase + symbol.blocksStart);
+                m_SymbolPrefixStart.push_back(prefixBase + symbol.prefixStart);
+                m_SymbolLibraries.push_back(symbol.library);
+                m_SymbolCrcAShared.push_back(symbol.crcAShared);
+                m_SymbolPrefixShared.push_back(symbol.prefixShared);
+                m_SymbolIsLowEntropy.push_back(symbol.bLowEntropy);
+            }
+
+            m_ParsedRelocs.insert(m_ParsedRelocs.end(), chunk->relocs.begin(), chunk->relocs.end());
+            m_AliasNames.insert(m_AliasNames.end(), chunk->aliases.begin(), chunk->aliases.end());
+
+            size_t aliasRelocBase = m_AliasRelocOffsets.size();
+
+            for(auto start : chunk->aliasRelocsStart)
+            {
+                m_AliasRelocsStart.push_back(aliasRelocBase + start);
+            }
+
+            for(auto& aliasReloc : chunk->aliasRelocs)
+            {
+                m_AliasRelocOffsets.push_back(aliasReloc.offset);
+                m_AliasRelocNames.push_back(aliasReloc.name);
+            }
+            m_BlockCrcs.insert(m_BlockCrcs.end(), chunk->blockCrcs.begin(), chunk->blockCrcs.end());
+
+            for(auto word : chunk->prefixWords)
+            {
+                m_PrefixWords.push_back(bswap32(word));
+            }
+
+            if(chunk->bErrored)
+            {
+                printf("error: line %d: %s\n", chunk->errorLine, chunk->errorMessage);
+                bErrored = true;
+            }
+        }
+
+        delete chunk;
+    }
+}
+
+size_t CSignatureFile::FindChunkBoundary(size_t pos)
+{
+    // returns the offset of the first symbol definition that follows a blank line,
+    // with either LF or CRLF line endings
+    while(pos < m_Size)
+    {
+        const char *newline = strchr(&m_Buffer[pos], '\n');
+
+        if(newline == NULL)
+        {
+            break;
+        }
+
+        pos = (newline - m_Buffer) + 1;
+
+        if(m_Buffer[pos] == '\r')
+        {
+            pos++;
+        }
+
+        if(m_Buffer[pos] != '\n')
+        {
+            continue;
+        }
+
+        while(m_Buffer[pos] == '\n' || m_Buffer[pos] == '\r')
+        {
+            pos++;
+        }
+
+        if(isalpha(m_Buffer[pos]) || m_Buffer[pos] == '_')
+        {
+            return pos;
+        }
+    }
+
+    return m_Size;
+}
+
+void *CSignatureFile::ParseChunkProc(void *_chunk)
+{
+    ParseChunk((parse_chunk_t *)_chunk);
+    return NULL;
+}
+
+void CSignatureFile::ParseChunk(parse_chunk_t *chunk)
 {
     const char *token;
-    while((token = GetNextToken()))
+    while((token = GetNextToken(chunk)))
     {
         top_level:
         
+        if(strcmp(token, ".alias") == 0)
+        {
+            // alias directive
+            if(chunk->symbols.size() == 0)
+            {
+                SetChunkError(chunk, "no symbol defined for this alias directive");
+                goto errored;
+            }
+
+            const char *aliasName = GetNextToken(chunk);
+
+            if(aliasName == NULL)
+            {
+                SetChunkError(chunk, "missing alias name");
+                goto errored;
+            }
+
+            chunk->aliases.push_back(aliasName);
+            chunk->aliasRelocsStart.push_back(chunk->aliasRelocs.size());
+            continue;
+        }
+
+        if(strcmp(token, ".relname") == 0)
+        {
+            // alias relocation name directive
+            if(chunk->symbols.size() == 0 || chunk->aliases.size() == chunk->symbols.back().aliasesStart)
+            {
+                SetChunkError(chunk, "no alias defined for this relname directive");
+                goto errored;
+            }
+
+            const char *relName = GetNextToken(chunk);
+
+            if(relName == NULL)
+            {
+                SetChunkError(chunk, "missing relocation name");
+                goto errored;
+            }
+
+            while((token = GetNextToken(chunk)))
+            {
+                uint32_t offset;
+                if(!ParseNumber(token, &offset))
+                {
+                    goto top_level;
+                }
+
+                chunk->aliasRelocs.push_back({relName, 0, offset});
+            }
+
+            continue;
+        }
+
+        if(strcmp(token, ".blocks") == 0)
+        {
+            // block crc directive
+            if(chunk->symbols.size() == 0)
+            {
+                SetChunkError(chunk, "no symbol defined for this block directive");
+                goto errored;
+            }
+
+            parsed_symbol_t& symbol = chunk->symbols.back();
+
+            if(symbol.blockSize != 0 ||
+               !ParseNumber(GetNextToken(chunk), &symbol.blockSize) ||
+               symbol.blockSize == 0 || symbol.blockSize % 4 != 0)
+            {
+                SetChunkError(chunk, "invalid block size");
+                goto errored;
+            }
+
+            while((token = GetNextToken(chunk)))
+            {
+                uint32_t blockCrc;
+                if(!ParseNumber(token, &blockCrc))
+                {
+                    break;
+                }
+
+                chunk->blockCrcs.push_back(blockCrc);
+            }
+
+            size_t numBlocks = chunk->blockCrcs.size() - symbol.blocksStart;
+
+            if(numBlocks != (symbol.size + symbol.blockSize - 1) / symbol.blockSize)
+            {
+                SetChunkError(chunk, "block count does not match symbol size");
+                goto errored;
+            }
+
+            if(token == NULL)
+            {
+                break;
+            }
+
+            goto top_level;
+        }
+
+        if(strcmp(token, ".object") == 0)
+        {
+            // data object directive
+            if(chunk->symbols.size() == 0)
+            {
+                SetChunkError(chunk, "no symbol defined for this object directive");
+                goto errored;
+            }
+
+            chunk->symbols.back().bData = true;
+            continue;
+        }
+
+        if(strcmp(token, ".library") == 0)
+        {
+            // owning library directive
+            if(chunk->symbols.size() == 0)
+            {
+                SetChunkError(chunk, "no symbol defined for this library directive");
+                goto errored;
+            }
+
+            const char *libraryName = GetNextToken(chunk);
+
+            if(libraryName == NULL)
+            {
+                SetChunkError(chunk, "missing library name");
+                goto errored;
+            }
+
+            chunk->symbols.back().library = libraryName;
+            continue;
+        }
+
+        if(strcmp(token, ".stats") == 0)
+        {
+            // ambiguity statistics directive
+            if(chunk->symbols.size() == 0)
+            {
+                SetChunkError(chunk, "no symbol defined for this stats directive");
+                goto errored;
+            }
+
+            parsed_symbol_t& symbol = chunk->symbols.back();
+            uint32_t lowEntropy;
+
+            if(symbol.bHaveStats)
+            {
+                SetChunkError(chunk, "duplicate stats directive");
+                goto errored;
+            }
+
+            if(!ParseNumber(GetNextToken(chunk), &symbol.crcAShared) ||
+               !ParseNumber(GetNextToken(chunk), &symbol.prefixShared) ||
+               !ParseNumber(GetNextToken(chunk), &lowEntropy) || lowEntropy > 1)
+            {
+                SetChunkError(chunk, "invalid stats");
+                goto errored;
+            }
+
+            symbol.bHaveStats = true;
+            symbol.bLowEntropy = (lowEntropy != 0);
+            continue;
+        }
+
+        if(strcmp(token, ".prefix") == 0)
+        {
+            // prefix word directive
+            if(chunk->symbols.size() == 0)
+            {
+                SetChunkError(chunk, "no symbol defined for this prefix directive");
+                goto errored;
+            }
+
+            parsed_symbol_t& symbol = chunk->symbols.back();
+
+            if(chunk->prefixWords.size() != symbol.prefixStart)
+            {
+                SetChunkError(chunk, "duplicate prefix directive");
+                goto errored;
+            }
+
+            while((token = GetNextToken(chunk)))
+            {
+                uint32_t word;
+                if(!ParseNumber(token, &word))
+                {
+                    break;
+                }
+
+                chunk->prefixWords.push_back(word);
+            }
+
+            if(chunk->prefixWords.size() - symbol.prefixStart > symbol.size / 4)
+            {
+                SetChunkError(chunk, "prefix is longer than the symbol");
+                goto errored;
+            }
+
+            if(token == NULL)
+            {
+                break;
+            }
+
+            goto top_level;
+        }
+
         if(token[0] == '.')
         {
             // relocation directive
             int relocType = GetRelocationDirectiveValue(token);
             if(relocType == -1)
             {
-                printf("error: invalid relocation directive '%s'\n", token);
+                SetChunkError(chunk, "invalid relocation directive '%s'", token);
                 goto errored;
             }
 
-            if(m_Symbols.size() == 0)
+            if(chunk->symbols.size() == 0)
             {
-                printf("error: no symbol defined for this relocation directive\n");
+                SetChunkError(chunk, "no symbol defined for this relocation directive");
+                goto errored;
             }
 
-            const char *relName = GetNextToken();
+            const char *relName = GetNextToken(chunk);
 
-            if(m_Symbols.back().relocs == NULL)
-            {
-                m_Symbols.back().relocs = new std::vector<reloc_t>;
-            }
-            
-            while((token = GetNextToken()))
+            while((token = GetNextToken(chunk)))
             {
                 uint32_t offset;
                 if(!ParseNumber(token, &offset))
@@ -362,7 +1016,7 @@ void CSignatureFile::Parse()
                     goto top_level;
                 }
 
-                m_Symbols.back().relocs->push_back({relName, (uint8_t)relocType, offset});
+                chunk->relocs.push_back({relName, (uint8_t)relocType, offset});
             }
 
             continue;
@@ -370,96 +1024,139 @@ void CSignatureFile::Parse()
 
         if(!isalpha(token[0]) && token[0] != '_')
         {
-            printf("error: unexpected '%s'\n", token);
+            SetChunkError(chunk, "unexpected '%s'", token);
             goto errored;
         }
 
-        symbol_info_t symbolInfo;
-        symbolInfo.relocs = NULL;
-        symbolInfo.name = token;
-
-        const char *szSize = GetNextToken();
-        const char *szCrcA = GetNextToken();
-        const char *szCrcB = GetNextToken();
-
-        if(!ParseNumber(szSize, &symbolInfo.size) ||
-           !ParseNumber(szCrcA, &symbolInfo.crcA) ||
-           !ParseNumber(szCrcB, &symbolInfo.crcB))
+        parsed_symbol_t symbol;
+        symbol.name = token;
+        symbol.relocsStart = chunk->relocs.size();
+        symbol.aliasesStart = chunk->aliases.size();
+        symbol.blockSize = 0;
+        symbol.blocksStart = chunk->blockCrcs.size();
+        symbol.prefixStart = chunk->prefixWords.size();
+        symbol.bData = false;
+        symbol.library = NULL;
+        symbol.bHaveStats = false;
+        symbol.crcAShared = 0;
+        symbol.prefixShared = 0;
+        symbol.bLowEntropy = false;
+
+        const char *szSize = GetNextToken(chunk);
+        const char *szCrcA = GetNextToken(chunk);
+        const char *szCrcB = GetNextToken(chunk);
+
+        if(!ParseNumber(szSize, &symbol.size) ||
+           !ParseNumber(szCrcA, &symbol.crcA) ||
+           !ParseNumber(szCrcB, &symbol.crcB))
         {
-            printf("error: invalid symbol parameters\n");
+            SetChunkError(chunk, "invalid symbol parameters");
             goto errored;
         }
 
-        m_Symbols.push_back(symbolInfo);
+        chunk->symbols.push_back(symbol);
     }
 
     errored:;
+
+    // sort each symbol's relocations by offset
+    for(size_t nSymbol = 0; nSymbol < chunk->symbols.size(); nSymbol++)
+    {
+        size_t relocsEnd = (nSymbol + 1 < chunk->symbols.size()) ?
+            chunk->symbols[nSymbol + 1].relocsStart : chunk->relocs.size();
+
+        std::sort(chunk->relocs.begin() + chunk->symbols[nSymbol].relocsStart,
+                  chunk->relocs.begin() + relocsEnd, RelocOffsetCompare);
+    }
 }
 
-bool CSignatureFile::IsEOF()
+void CSignatureFile::SetChunkError(parse_chunk_t *chunk, const char *format, ...)
 {
-    return (m_Pos >= m_Size);
+    va_list args;
+    va_start(args, format);
+    vsnprintf(chunk->errorMessage, sizeof(chunk->errorMessage), format, args);
+    va_end(args);
+
+    chunk->errorLine = chunk->tokenLine;
+    chunk->bErrored = true;
 }
 
-bool CSignatureFile::AtEndOfLine()
+bool CSignatureFile::IsEOF(parse_chunk_t *chunk)
 {
-    while(!IsEOF() && (m_Buffer[m_Pos] == ' ' || m_Buffer[m_Pos] == '\t' || m_Buffer[m_Pos] == '\r'))
-    {
-        m_Pos++;
-    }
-
-    return (m_Buffer[m_Pos] == '\n' || m_Buffer[m_Pos] == '\0');
+    return (chunk->pos >= chunk->size);
 }
 
-void CSignatureFile::SkipWhitespace()
+void CSignatureFile::SkipWhitespace(parse_chunk_t *chunk)
 {
-    while(!IsEOF() && isspace(m_Buffer[m_Pos]))
+    const char *buffer = chunk->buffer;
+
+    while(!IsEOF(chunk) && isspace(buffer[chunk->pos]))
     {
-        m_Pos++;
+        if(buffer[chunk->pos] == '\n')
+        {
+            chunk->line++;
+        }
+        chunk->pos++;
     }
 
-    while(m_Buffer[m_Pos] == '#')
+    while(!IsEOF(chunk) && buffer[chunk->pos] == '#')
     {
-        while(!IsEOF() && m_Buffer[m_Pos] != '\n')
+        while(!IsEOF(chunk) && buffer[chunk->pos] != '\n')
         {
-            m_Pos++;
+            chunk->pos++;
         }
 
-        while(!IsEOF() && isspace(m_Buffer[m_Pos]))
+        while(!IsEOF(chunk) && isspace(buffer[chunk->pos]))
         {
-            m_Pos++;
+            if(buffer[chunk->pos] == '\n')
+            {
+                chunk->line++;
+            }
+            chunk->pos++;
         }
     }
 }
 
-char *CSignatureFile::GetNextToken()
+char *CSignatureFile::GetNextToken(parse_chunk_t *chunk)
 {
-    if(IsEOF())
+    if(IsEOF(chunk))
     {
         return NULL;
     }
 
-    SkipWhitespace();
+    SkipWhitespace(chunk);
 
-    if(IsEOF())
+    if(IsEOF(chunk))
     {
         return NULL;
     }
 
-    size_t tokenPos = m_Pos;
+    char *buffer = chunk->buffer;
+    size_t tokenPos = chunk->pos;
+    chunk->tokenLine = chunk->line;
 
-    while(!IsEOF() && !isspace(m_Buffer[m_Pos]))
+    while(!IsEOF(chunk) && !isspace(buffer[chunk->pos]))
     {
-        m_Pos++;
+        chunk->pos++;
     }
 
-    m_Buffer[m_Pos++] = '\0';
+    if(buffer[chunk->pos] == '\n')
+    {
+        chunk->line++;
+    }
+
+    buffer[chunk->pos++] = '\0';
 
-    return &m_Buffer[tokenPos];
+    return &buffer[tokenPos];
 }
 
 bool CSignatureFile::ParseNumber(const char *str, uint32_t *result)
 {
+    if(str == NULL)
+    {
+        return false;
+    }
+
     char *endp;
     *result = strtoull(str, &endp, 0);
     return (size_t)(endp - str) == strlen(str);
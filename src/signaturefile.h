@@ -12,6 +12,8 @@
 #include <cstdint>
 #include <vector>
 
+#include "threadpool.h"
+
 class CSignatureFile
 {
 private:
@@ -28,37 +30,144 @@ private:
         uint32_t    size;
         uint32_t    crcA;
         uint32_t    crcB;
-        std::vector<reloc_t> *relocs;
-    } symbol_info_t;
+        size_t      relocsStart;  // index of first relocation in the chunk's relocs
+        size_t      aliasesStart; // index of first alias in the chunk's aliases
+        uint32_t    blockSize;
+        size_t      blocksStart;  // index of first block crc in the chunk's blockCrcs
+        size_t      prefixStart;  // index of first prefix word in the chunk's prefixWords
+        bool        bData;
+        const char *library;      // NULL if not given
+        bool        bHaveStats;
+        uint32_t    crcAShared;
+        uint32_t    prefixShared;
+        bool        bLowEntropy;
+    } parsed_symbol_t;
+
+    // independently tokenized piece of the buffer, see Parse()
+    typedef struct
+    {
+        char  *buffer;
+        size_t size;
+        size_t pos;
+        int    line;      // line number at pos
+        int    tokenLine; // line number of the last token
+        bool   bErrored;
+        int    errorLine;
+        char   errorMessage[128];
+        std::vector<parsed_symbol_t> symbols;
+        std::vector<reloc_t> relocs;
+        std::vector<const char *> aliases;
+        std::vector<size_t> aliasRelocsStart; // index of each alias's first entry in aliasRelocs
+        std::vector<reloc_t> aliasRelocs;     // relocation names of aliases, type is unused
+        std::vector<uint32_t> blockCrcs;
+        std::vector<uint32_t> prefixWords;
+    } parse_chunk_t;
+
+    char    *m_Buffer;
+    size_t   m_Size;
+    uint32_t m_Crc; // of the contents before they are parsed
+
+    // symbol table, one element per symbol
+    std::vector<const char *> m_SymbolNames;
+    std::vector<uint32_t>     m_SymbolSizes;
+    std::vector<uint32_t>     m_SymbolCrcA;
+    std::vector<uint32_t>     m_SymbolCrcB;
+    std::vector<uint32_t>     m_SymbolRelocsStart;  // index of first relocation, has an extra end element
+    std::vector<uint32_t>     m_SymbolAliasesStart; // index of first alias, has an extra end element
+    std::vector<uint32_t>     m_SymbolBlockSize;    // 0 if the symbol has no block crcs
+    std::vector<uint8_t>      m_SymbolIsData;       // 1 for data objects, 0 for functions
+    std::vector<uint32_t>     m_SymbolBlocksStart;  // index of first block crc, has an extra end element
+    std::vector<uint32_t>     m_SymbolPrefixStart;  // index of first prefix word, has an extra end element
+    std::vector<const char *> m_SymbolLibraries;    // NULL if the library is not known
+
+    // ambiguity statistics, see .stats
+    std::vector<uint32_t>     m_SymbolCrcAShared;   // number of other symbols with the same crcA
+    std::vector<uint32_t>     m_SymbolPrefixShared; // number of other symbols that start with the same prefix words
+    std::vector<uint8_t>      m_SymbolIsLowEntropy; // 1 for tiny or repetitive bodies that match almost anywhere
+
+    // crcs of fixed-size blocks of symbol data, for early rejection and partial matching
+    std::vector<uint32_t>     m_BlockCrcs;
 
-    char  *m_Buffer;
-    size_t m_Size;
-    size_t m_Pos;
+    // leading words of symbol data that set it apart from other symbols, for early rejection
+    std::vector<uint32_t>     m_PrefixWords; // in buffer byte order
+    std::vector<uint32_t>     m_PrefixMasks; // AND-mask for each prefix word, in buffer byte order
 
-    std::vector<symbol_info_t> m_Symbols;
+    // other names for symbols with identical bodies
+    std::vector<const char *> m_AliasNames;
+    std::vector<uint32_t>     m_AliasRelocsStart; // index of first renamed relocation, has an extra end element
+
+    // relocations that target a different name under an alias, see .relname
+    std::vector<uint32_t>     m_AliasRelocOffsets;
+    std::vector<const char *> m_AliasRelocNames;
+
+    // relocation table, grouped by symbol and sorted by offset
+    std::vector<uint32_t>     m_RelocOffsets;
+    std::vector<uint32_t>     m_RelocMasks; // AND-mask for the relocated word, in buffer byte order
+    std::vector<uint8_t>      m_RelocTypes;
+    std::vector<const char *> m_RelocNames;
+
+    // relocations collected by Parse() before they are sorted into the tables above
+    std::vector<reloc_t> m_ParsedRelocs;
 
     static bool ParseNumber(const char *str, uint32_t *result);
     static int GetRelocationDirectiveValue(const char *str);
     static bool RelocOffsetCompare(const reloc_t& a, const reloc_t& b);
-    static void ReadStrippedWord(uint8_t *dst, const uint8_t *src, int relType);
+    static uint32_t GetRelocationMask(int relType);
+    static void CrcReadMasked(const uint8_t *buffer, uint32_t offset, uint32_t end,
+        const uint32_t *relOffsets, const uint32_t *relMasks, size_t numRelocs, size_t *nReloc, uint32_t *crc, uint32_t *crc2 = NULL);
+    static void CrcRead(const uint8_t *bytes, size_t length, uint32_t *crc, uint32_t *crc2);
+
+    static void SkipWhitespace(parse_chunk_t *chunk);
+    static char *GetNextToken(parse_chunk_t *chunk);
+    static bool IsEOF(parse_chunk_t *chunk);
+    static void SetChunkError(parse_chunk_t *chunk, const char *format, ...);
+    static void ParseChunk(parse_chunk_t *chunk);
+    static void *ParseChunkProc(void *_chunk);
 
-    void SkipWhitespace();
-    char *GetNextToken();
-    bool AtEndOfLine();
-    void Parse();
-    bool IsEOF();
+    size_t FindChunkBoundary(size_t pos);
+    void Parse(CThreadPool *threadPool);
 
-    void SortRelocationsByOffset();
+    void Reset();
+    void BuildRelocationTables();
 
 public:
     CSignatureFile();
     ~CSignatureFile();
-    bool Load(const char *path);
-    bool LoadFromMemory(const char *contents);
+    // threadPool parses large files in parallel, a temporary one is used if it is NULL
+    bool Load(const char *path, CThreadPool *threadPool = NULL);
+    bool LoadFromMemory(const char *contents, CThreadPool *threadPool = NULL);
     size_t GetNumSymbols();
+    uint32_t GetCrc();
     uint32_t GetSymbolSize(size_t nSymbol);
+    uint32_t GetSymbolCrcA(size_t nSymbol);
+    uint32_t GetSymbolCrcB(size_t nSymbol);
     bool GetSymbolName(size_t nSymbol, char *str, size_t nMaxChars);
-    bool TestSymbol(size_t nSymbol, const uint8_t *buffer);
+    bool IsDataSymbol(size_t nSymbol);
+    bool GetSymbolLibrary(size_t nSymbol, char *str, size_t nMaxChars);
+    bool TestSymbol(size_t nSymbol, const uint8_t *buffer, uint32_t *nBytesMatched = NULL);
+
+    // blocks
+    uint32_t GetBlockSize(size_t nSymbol);
+    size_t GetNumBlocks(size_t nSymbol);
+    uint32_t GetBlockCrc(size_t nSymbol, size_t nBlock);
+
+    // prefix words
+    size_t GetNumPrefixWords(size_t nSymbol);
+    uint32_t GetPrefixWord(size_t nSymbol, size_t nWord);
+
+    // ambiguity statistics
+    uint32_t GetSymbolCrcAShared(size_t nSymbol);
+    uint32_t GetSymbolPrefixShared(size_t nSymbol);
+    bool IsLowEntropySymbol(size_t nSymbol);
+    bool IsAmbiguousSymbol(size_t nSymbol);
+
+    // aliases
+    size_t GetNumAliases(size_t nSymbol);
+    bool GetAliasName(size_t nSymbol, size_t nAlias, char *str, size_t nMaxChars);
+    size_t GetNumAliasRelocs(size_t nSymbol, size_t nAlias);
+    uint32_t GetAliasRelocOffset(size_t nSymbol, size_t nAlias, size_t nAliasReloc);
+    bool GetAliasRelocName(size_t nSymbol, size_t nAlias, size_t nAliasReloc, char *str, size_t nMaxChars);
+    bool HaveAliasRelocs(size_t nSymbol);
 
     // relocs
     size_t GetNumRelocs(size_t nSymbol);
@@ -0,0 +1,77 @@
+/*
+
+    String interning for n64sig
+    shygoo 2020
+    License: MIT
+
+*/
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "stringpool.h"
+
+CStringPool::CStringPool() :
+    m_Count(0)
+{
+    pthread_mutex_init(&m_Mutex, NULL);
+    Intern("");
+}
+
+CStringPool::~CStringPool()
+{
+    uint32_t numChunks = (m_Count + STRINGPOOL_CHUNK_SIZE - 1) / STRINGPOOL_CHUNK_SIZE;
+
+    for(uint32_t nChunk = 0; nChunk < numChunks; nChunk++)
+    {
+        delete[] m_Chunks[nChunk];
+    }
+
+    pthread_mutex_destroy(&m_Mutex);
+}
+
+uint32_t CStringPool::Intern(const char *str)
+{
+    pthread_mutex_lock(&m_Mutex);
+
+    uint32_t count = m_Count.load(std::memory_order_relaxed);
+    auto inserted = m_Ids.insert({ str, count });
+
+    if(inserted.second)
+    {
+        if(count == STRINGPOOL_CHUNK_SIZE * STRINGPOOL_MAX_CHUNKS)
+        {
+            printf("Error: Too many distinct names\n");
+            exit(EXIT_FAILURE);
+        }
+
+        if(count % STRINGPOOL_CHUNK_SIZE == 0)
+        {
+            m_Chunks[count / STRINGPOOL_CHUNK_SIZE] = new const char *[STRINGPOOL_CHUNK_SIZE];
+        }
+
+        // unordered_map nodes do not move, so the key can be referenced directly
+        m_Chunks[count / STRINGPOOL_CHUNK_SIZE][count % STRINGPOOL_CHUNK_SIZE] = inserted.first->first.c_str();
+        m_Count.store(count + 1, std::memory_order_release);
+    }
+
+    uint32_t id = inserted.first->second;
+
+    pthread_mutex_unlock(&m_Mutex);
+    return id;
+}
+
+const char *CStringPool::Get(uint32_t id)
+{
+    if(id >= m_Count.load(std::memory_order_acquire))
+    {
+        return "";
+    }
+
+    return m_Chunks[id / STRINGPOOL_CHUNK_SIZE][id % STRINGPOOL_CHUNK_SIZE];
+}
+
+size_t CStringPool::GetCount()
+{
+    return m_Count.load(std::memory_order_acquire);
+}
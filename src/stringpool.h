@@ -0,0 +1,41 @@
+/*
+
+    String interning for n64sig
+    shygoo 2020
+    License: MIT
+
+*/
+
+#ifndef STRINGPOOL_H
+#define STRINGPOOL_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <atomic>
+#include <pthread.h>
+
+// ids per chunk of the id table, chunks are never moved once allocated
+#define STRINGPOOL_CHUNK_SIZE 0x1000
+#define STRINGPOOL_MAX_CHUNKS 0x1000
+
+// maps each distinct string to a 32-bit id, safe to use from several threads
+// id 0 is always the empty string
+// Intern() is locked, Get() is not, so that sorting and writing by name stays cheap
+class CStringPool
+{
+    std::unordered_map<std::string, uint32_t> m_Ids;
+    const char **m_Chunks[STRINGPOOL_MAX_CHUNKS]; // point at the keys of m_Ids
+    std::atomic<uint32_t> m_Count; // ids below this are readable
+    pthread_mutex_t m_Mutex;
+
+public:
+    CStringPool();
+    ~CStringPool();
+
+    uint32_t Intern(const char *str);
+    const char *Get(uint32_t id);
+    size_t GetCount();
+};
+
+#endif // STRINGPOOL_H
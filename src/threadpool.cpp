@@ -45,6 +45,15 @@ int CThreadPool::GetNumCPUCores()
     #endif
 }
 
+// only call while no workers are running
+void CThreadPool::SetNumWorkers(int numWorkers)
+{
+    delete[] m_Workers;
+    m_NumWorkers = numWorkers;
+    m_Workers = new worker_context_t[m_NumWorkers];
+    memset(m_Workers, 0, sizeof(worker_context_t) * m_NumWorkers);
+}
+
 void* CThreadPool::RoutineProc(void* _worker)
 {
     worker_context_t* worker = (worker_context_t*) _worker;
@@ -67,6 +76,8 @@ void CThreadPool::AddWorker(worker_routine_t routine, void* param)
                 worker->param = param;
                 worker->routine = routine;
                 pthread_create(&worker->pthread, NULL, RoutineProc, (void*)worker);
+                // workers are never joined, let their resources go when they finish
+                pthread_detach(worker->pthread);
                 return;
             }
         }
@@ -38,6 +38,7 @@ public:
     CThreadPool();
     ~CThreadPool();
     int GetNumCPUCores();
+    void SetNumWorkers(int numWorkers);
 
     void WaitForWorkers();
     void AddWorker(worker_routine_t routine, void* param);
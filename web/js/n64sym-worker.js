@@ -77,6 +77,13 @@ function readStrippedOpcode(binary, offset, relocType)
         break;
     case 'hi16':
     case 'lo16':
+    case 'gprel16':
+        opcode[2] = 0x00;
+        opcode[3] = 0x00;
+        break;
+    case 'abs32':
+        opcode[0] = 0x00;
+        opcode[1] = 0x00;
         opcode[2] = 0x00;
         opcode[3] = 0x00;
         break;